@@ -0,0 +1,82 @@
+--[[
+
+Copyright 2012 connectFree k.k. and the lev authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+-- raw access to lev.buffer bytes through the LuaJIT FFI.
+--
+-- buf[i] and buf:readUInt8(i) are C function calls, which end a JIT trace;
+-- a uint8_t pointer from here is indexed inline by compiled code. every
+-- pointer handed out keeps its buffer alive for as long as the pointer
+-- cdata itself is reachable, and the buffer is taken off the automatic
+-- compaction list so the bytes stay where they are.
+local ffi = require('ffi')
+local lev = require('lev')
+
+local bufferffi = {}
+
+-- must match MemSlice in src/lev_slab.h; "until" is a Lua keyword, so the
+-- length goes by "len" here
+ffi.cdef[[
+typedef struct lev_MemBlock lev_MemBlock;
+typedef struct lev_MemSlice {
+  lev_MemBlock *mb;
+  uint8_t *slice;
+  size_t len;
+  int pinned;
+} lev_MemSlice;
+]]
+
+local MemSlice_ptr = ffi.typeof('lev_MemSlice *')
+local uint8_ptr = ffi.typeof('uint8_t *')
+local cast = ffi.cast
+local setmetatable = setmetatable
+
+-- pointer cdata -> buffer; weak keys, so an entry goes with its pointer
+local anchors = setmetatable({}, { __mode = 'k' })
+
+-- the buffer's MemSlice, read and written in place (its bytes are pinned
+-- from here on, see buf:ptr())
+function bufferffi.slice(buf)
+  buf:ptr() -- untrack
+  local ms = cast(MemSlice_ptr, buf)
+  anchors[ms] = buf
+  return ms
+end
+
+-- uint8_t pointer to the first byte (index 0), and the length. pointer
+-- arithmetic makes new cdata that do not anchor anything: keep the one
+-- returned here around while its derivatives are in use.
+function bufferffi.ptr(buf)
+  local p, len = buf:ptr()
+  p = cast(uint8_ptr, p)
+  anchors[p] = buf
+  return p, len
+end
+
+-- kept for older callers; ptr pins too now
+bufferffi.pin = bufferffi.ptr
+
+-- refuse to hand out pointers if the C side changed under us
+do
+  local buf = lev.buffer:new('lev')
+  local p, len = buf:ptr()
+  local ms = cast(MemSlice_ptr, buf)
+  assert(cast(uint8_ptr, p) == ms.slice and len == tonumber(ms.len),
+    'bufferffi: lev_MemSlice does not match MemSlice')
+end
+
+return bufferffi
@@ -45,6 +45,8 @@ _G.print = utils.print
 _G.p = utils.prettyPrint
 _G.debug = utils.debug
 _G.Buffer = lev.buffer
+_G.BufferList = lev.bufferlist
+_G.BufferWriter = lev.bufferwriter
 
 _G.WorkerID = lev.getenv("LEV_WORKER_ID")
 
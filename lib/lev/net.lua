@@ -26,15 +26,50 @@ net.createTCPConnection = function(host, port, callback)
 
 end
 
-net.createServer = function(host, port, callback)
+-- listeners of this worker, for net.acceptCounts(): server -> "host:port".
+-- weak keys, so a closed server goes once it is collected
+local servers = setmetatable({}, {__mode = 'k'})
+
+local listen = function(server, host, port, callback, opts)
+  local err = server:listen(callback, 511, opts)
+  if err then
+    server:close()
+    return callback(nil, err)
+  end
+  servers[server] = host .. ':' .. port
+end
+
+-- by default the master binds once and hands every worker the same fd.
+-- with opts.reuseport (or LEV_REUSEPORT=1 in the environment) each worker
+-- binds its own SO_REUSEPORT socket instead and the kernel balances new
+-- connections between them. opts also goes to server:listen, so
+-- opts.batch hands the callback accepted clients (see tcp listen).
+net.createServer = function(host, port, callback, opts)
+  local reuseport = (opts and opts.reuseport) or lev.getenv("LEV_REUSEPORT") == "1"
+  if reuseport then
+    local server = ltcp.new()
+    local err = server:bind(host, port, true)
+    if err then return callback(nil, err) end
+    return listen(server, host, port, callback, opts)
+  end
+
   mbox.toMaster(
      "bind"
     ,{type='tcp', address=host, port=port}
     ,function(rpkt, err)
       if err then return callback(nil, err) end
       local server = ltcp.new( rpkt._cmsg.fd )
-      server:listen(callback, 511)
+      listen(server, host, port, callback, opts)
     end)
 end
 
+-- connections this worker accepted, by "host:port"
+net.acceptCounts = function()
+  local counts = {}
+  for server, name in pairs(servers) do
+    counts[name] = (counts[name] or 0) + server:accept_stats().accepted
+  end
+  return counts
+end
+
 return net
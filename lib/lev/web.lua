@@ -72,7 +72,9 @@ function web.createServer(host, port, onRequest, onData)
   if not onRequest then error("onRequest is a required parameter") end
   net.createServer(host or "0.0.0.0", port, function(s, err)
     local client = s:accept()
+    if not client then return end -- the connection went away before accept
     client:nodelay(1)
+    client:autocork(true) -- header and body writes go out together
 
 --- X:S PARSER
     local currentField, headers, url, request, response, parser
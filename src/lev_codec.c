@@ -0,0 +1,472 @@
+/*
+ *  Copyright 2012 connectFree k.k. and the lev authors. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "lev_codec.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+  #define LEV_CODEC_SSE2 /* part of the x86_64 baseline */
+  #include <emmintrin.h>
+  #if defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+    #define LEV_CODEC_SSSE3 /* compiled per function, used only if the CPU has it */
+    #include <tmmintrin.h>
+  #endif
+#endif
+
+/*
+  every kernel converts as many whole blocks as it likes and returns how
+  much input it consumed; the generic code below finishes the rest, so the
+  SIMD kernels never deal with tails, padding or error reporting.
+*/
+typedef size_t (*hex_encode_fn)(unsigned char *, const unsigned char *, size_t, int);
+typedef size_t (*hex_decode_fn)(unsigned char *, const unsigned char *, size_t);
+typedef size_t (*base64_encode_fn)(unsigned char *, const unsigned char *, size_t, int);
+typedef size_t (*base64_decode_fn)(unsigned char *, const unsigned char *, size_t, int);
+
+static const char hex_lower[] = "0123456789abcdef";
+static const char hex_upper[] = "0123456789ABCDEF";
+
+static const char base64_std[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char base64_url[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+/* reverse tables, 0xff for bytes outside the alphabet; built on first use */
+static unsigned char hex_values[256];
+static unsigned char base64_std_values[256];
+static unsigned char base64_url_values[256];
+
+/* X:S generic */
+
+static size_t hex_encode_generic(unsigned char *dst, const unsigned char *src, size_t len, int upper) {
+  const char *digits = upper ? hex_upper : hex_lower;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    *dst++ = digits[src[i] >> 4];
+    *dst++ = digits[src[i] & 15];
+  }
+  return len;
+}
+
+static size_t hex_decode_generic(unsigned char *dst, const unsigned char *src, size_t len) {
+  unsigned char hi, lo;
+  size_t i;
+
+  for (i = 0; i + 2 <= len; i += 2) {
+    hi = hex_values[src[i]];
+    lo = hex_values[src[i + 1]];
+    if ((hi | lo) == 0xff) {
+      break;
+    }
+    *dst++ = (unsigned char)(hi << 4 | lo);
+  }
+  return i;
+}
+
+static size_t base64_encode_generic(unsigned char *dst, const unsigned char *src, size_t len, int flags) {
+  const char *alphabet = (flags & LEV_BASE64_URL) ? base64_url : base64_std;
+  unsigned int v;
+  size_t i;
+
+  for (i = 0; i + 3 <= len; i += 3) {
+    v = (unsigned int)src[i] << 16 | (unsigned int)src[i + 1] << 8 | src[i + 2];
+    *dst++ = alphabet[v >> 18];
+    *dst++ = alphabet[(v >> 12) & 63];
+    *dst++ = alphabet[(v >> 6) & 63];
+    *dst++ = alphabet[v & 63];
+  }
+  return i;
+}
+
+static size_t base64_decode_generic(unsigned char *dst, const unsigned char *src, size_t len, int flags) {
+  const unsigned char *values = (flags & LEV_BASE64_URL) ? base64_url_values : base64_std_values;
+  unsigned char a, b, c, d;
+  size_t i;
+
+  for (i = 0; i + 4 <= len; i += 4) {
+    a = values[src[i]];
+    b = values[src[i + 1]];
+    c = values[src[i + 2]];
+    d = values[src[i + 3]];
+    if ((a | b | c | d) == 0xff) {
+      break;
+    }
+    *dst++ = (unsigned char)(a << 2 | b >> 4);
+    *dst++ = (unsigned char)(b << 4 | c >> 2);
+    *dst++ = (unsigned char)(c << 6 | d);
+  }
+  return i;
+}
+
+/* X:E generic */
+
+#ifdef LEV_CODEC_SSE2
+
+/* 16 bytes -> 32 digits: split the nibbles, interleave, then '0' + n (+ 'a' - '0' - 10 past 9) */
+static size_t hex_encode_sse2(unsigned char *dst, const unsigned char *src, size_t len, int upper) {
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  const __m128i nine = _mm_set1_epi8(9);
+  const __m128i zero = _mm_set1_epi8('0');
+  const __m128i alpha = _mm_set1_epi8((upper ? 'A' : 'a') - '0' - 10);
+  __m128i in, hi, lo, a, b;
+  size_t i;
+
+  for (i = 0; i + 16 <= len; i += 16) {
+    in = _mm_loadu_si128((const __m128i *)(src + i));
+    hi = _mm_and_si128(_mm_srli_epi16(in, 4), mask);
+    lo = _mm_and_si128(in, mask);
+    a = _mm_unpacklo_epi8(hi, lo);
+    b = _mm_unpackhi_epi8(hi, lo);
+    a = _mm_add_epi8(_mm_add_epi8(a, zero), _mm_and_si128(_mm_cmpgt_epi8(a, nine), alpha));
+    b = _mm_add_epi8(_mm_add_epi8(b, zero), _mm_and_si128(_mm_cmpgt_epi8(b, nine), alpha));
+    _mm_storeu_si128((__m128i *)(dst + 2 * i), a);
+    _mm_storeu_si128((__m128i *)(dst + 2 * i + 16), b);
+  }
+  return i;
+}
+
+/* one 16 digit half: nibble values, and a movemask of the valid digits */
+static __m128i hex_nibbles_sse2(__m128i in, int *valid) {
+  const __m128i digit = _mm_sub_epi8(in, _mm_set1_epi8('0'));
+  const __m128i letter = _mm_sub_epi8(_mm_or_si128(in, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+  /* unsigned x <= n as min(x, n) == x */
+  const __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+  const __m128i is_letter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+
+  *valid = _mm_movemask_epi8(_mm_or_si128(is_digit, is_letter));
+  return _mm_or_si128(_mm_and_si128(is_digit, digit),
+                      _mm_and_si128(is_letter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+/* 32 digits -> 16 bytes; each 16 bit lane holds (hi, lo) which becomes hi << 4 | lo */
+static size_t hex_decode_sse2(unsigned char *dst, const unsigned char *src, size_t len) {
+  const __m128i low_byte = _mm_set1_epi16(0x00ff);
+  __m128i a, b;
+  int va, vb;
+  size_t i;
+
+  for (i = 0; i + 32 <= len; i += 32) {
+    a = hex_nibbles_sse2(_mm_loadu_si128((const __m128i *)(src + i)), &va);
+    b = hex_nibbles_sse2(_mm_loadu_si128((const __m128i *)(src + i + 16)), &vb);
+    if ((va & vb) != 0xffff) {
+      break;
+    }
+    a = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(a, low_byte), 4), _mm_srli_epi16(a, 8));
+    b = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(b, low_byte), 4), _mm_srli_epi16(b, 8));
+    _mm_storeu_si128((__m128i *)(dst + i / 2), _mm_packus_epi16(a, b));
+  }
+  return i;
+}
+
+#endif
+
+#ifdef LEV_CODEC_SSSE3
+
+/*
+  base64 after Wojciech Mula's SSSE3 codecs: pshufb spreads 12 bytes over
+  16 lanes, two multiplies line the 6 bit groups up, and a 16 entry pshufb
+  table maps each group's range to the offset of its character.
+*/
+__attribute__((target("ssse3")))
+static size_t base64_encode_ssse3(unsigned char *dst, const unsigned char *src, size_t len, int flags) {
+  const __m128i spread = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  const __m128i shift = (flags & LEV_BASE64_URL)
+    ? _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                    '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0)
+    : _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                    '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  __m128i in, t0, t1, t2, t3, indices, range;
+  size_t i, o = 0;
+
+  /* 16 byte loads of which 12 are used */
+  for (i = 0; i + 16 <= len; i += 12, o += 16) {
+    in = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i)), spread);
+    t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    indices = _mm_or_si128(t1, t3);
+
+    range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices),
+                                              _mm_set1_epi8(13)));
+    _mm_storeu_si128((__m128i *)(dst + o),
+                     _mm_add_epi8(_mm_shuffle_epi8(shift, range), indices));
+  }
+  return i;
+}
+
+/* standard alphabet only; the nibble tables below encode '+' and '/' */
+__attribute__((target("ssse3")))
+static size_t base64_decode_ssse3(unsigned char *dst, const unsigned char *src, size_t len, int flags) {
+  const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                       0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                       0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                         0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m128i mask = _mm_set1_epi8(0x2f);
+  __m128i in, hi, lo, roll, merged;
+  size_t i, o = 0;
+
+  if (flags & LEV_BASE64_URL) {
+    return 0;
+  }
+
+  /* 16 byte stores of which 12 are used; stop while the rest covers the spill */
+  for (i = 0; i + 32 <= len; i += 16, o += 12) {
+    in = _mm_loadu_si128((const __m128i *)(src + i));
+    hi = _mm_and_si128(_mm_srli_epi32(in, 4), mask);
+    lo = _mm_and_si128(in, mask);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(_mm_shuffle_epi8(lut_lo, lo),
+                                                       _mm_shuffle_epi8(lut_hi, hi)),
+                                         _mm_setzero_si128())) != 0xffff) {
+      break;
+    }
+    roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(in, mask), hi));
+    in = _mm_add_epi8(in, roll);
+
+    merged = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+    merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128((__m128i *)(dst + o), _mm_shuffle_epi8(merged, pack));
+  }
+  return i;
+}
+
+#endif
+
+/* X:S dispatch */
+
+static struct {
+  const char *name;
+  hex_encode_fn hex_encode;
+  hex_decode_fn hex_decode;
+  base64_encode_fn base64_encode;
+  base64_decode_fn base64_decode;
+} codec_kernels[] = {
+   { "generic", hex_encode_generic, hex_decode_generic, base64_encode_generic, base64_decode_generic }
+#ifdef LEV_CODEC_SSE2
+  ,{ "sse2",    hex_encode_sse2,    hex_decode_sse2,    base64_encode_generic, base64_decode_generic }
+#endif
+#ifdef LEV_CODEC_SSSE3
+  ,{ "ssse3",   hex_encode_sse2,    hex_decode_sse2,    base64_encode_ssse3,   base64_decode_ssse3   }
+#endif
+};
+
+#define CODEC_KERNEL_COUNT (int)(sizeof(codec_kernels) / sizeof(codec_kernels[0]))
+
+static int codec_kernel = -1;
+
+static int _lev_codec_supported(int i) {
+#ifdef LEV_CODEC_SSSE3
+  if (codec_kernels[i].base64_encode == base64_encode_ssse3) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+  }
+#endif
+  return 1;
+}
+
+static void _lev_codec_tables() {
+  static int built = 0;
+  int i;
+
+  if (built) {
+    return;
+  }
+  memset(hex_values, 0xff, sizeof(hex_values));
+  memset(base64_std_values, 0xff, sizeof(base64_std_values));
+  memset(base64_url_values, 0xff, sizeof(base64_url_values));
+  for (i = 0; i < 16; i++) {
+    hex_values[(unsigned char)hex_lower[i]] = i;
+    hex_values[(unsigned char)hex_upper[i]] = i;
+  }
+  for (i = 0; i < 64; i++) {
+    base64_std_values[(unsigned char)base64_std[i]] = i;
+    base64_url_values[(unsigned char)base64_url[i]] = i;
+  }
+  built = 1;
+}
+
+static void _lev_codec_init() {
+  int i;
+
+  if (lev_codec_set_kernel(getenv("LEV_CODEC_KERNEL")) == 0) {
+    return;
+  }
+  for (i = CODEC_KERNEL_COUNT - 1; i > 0 && !_lev_codec_supported(i); i--)
+    ;
+  codec_kernel = i; /* the best one this CPU runs */
+}
+
+#define CODEC_KERNEL() \
+  (codec_kernel < 0 ? _lev_codec_init() : (void)0, &codec_kernels[codec_kernel])
+
+/* returns -1 if name is unknown or this CPU cannot run it */
+int lev_codec_set_kernel(const char *name) {
+  int i;
+
+  _lev_codec_tables();
+  if (!name) {
+    return -1;
+  }
+  for (i = 0; i < CODEC_KERNEL_COUNT; i++) {
+    if (!strcmp(name, codec_kernels[i].name) && _lev_codec_supported(i)) {
+      codec_kernel = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+const char *lev_codec_kernel_name() {
+  return CODEC_KERNEL()->name;
+}
+
+/* X:E dispatch */
+
+/* X:S hex */
+
+size_t lev_hex_encode(unsigned char *dst, const unsigned char *src, size_t len, int upper) {
+  size_t done = CODEC_KERNEL()->hex_encode(dst, src, len, upper);
+
+  hex_encode_generic(dst + 2 * done, src + done, len - done, upper);
+  return lev_hex_encoded_len(len);
+}
+
+size_t lev_hex_decoded_len(size_t len) {
+  return len & 1 ? (size_t)-1 : len / 2;
+}
+
+int lev_hex_decode(unsigned char *dst, const unsigned char *src, size_t len) {
+  size_t done;
+
+  if (len & 1) {
+    return -1;
+  }
+  done = CODEC_KERNEL()->hex_decode(dst, src, len);
+  if (done < len) {
+    done += hex_decode_generic(dst + done / 2, src + done, len - done);
+  }
+  return done == len ? 0 : -1;
+}
+
+/* X:E hex */
+
+/* X:S base64 */
+
+size_t lev_base64_encoded_len(size_t n, int flags) {
+  if (flags & LEV_BASE64_URL) {
+    return n / 3 * 4 + (n % 3 ? n % 3 + 1 : 0);
+  }
+  return (n + 2) / 3 * 4;
+}
+
+size_t lev_base64_encode(unsigned char *dst, const unsigned char *src, size_t len, int flags) {
+  const char *alphabet = (flags & LEV_BASE64_URL) ? base64_url : base64_std;
+  unsigned char *out;
+  size_t done;
+  unsigned int v;
+
+  done = CODEC_KERNEL()->base64_encode(dst, src, len, flags);
+  done += base64_encode_generic(dst + done / 3 * 4, src + done, len - done, flags);
+  out = dst + done / 3 * 4;
+
+  if (len - done) {
+    v = (unsigned int)src[done] << 16;
+    if (len - done == 2) {
+      v |= (unsigned int)src[done + 1] << 8;
+    }
+    *out++ = alphabet[v >> 18];
+    *out++ = alphabet[(v >> 12) & 63];
+    if (len - done == 2) {
+      *out++ = alphabet[(v >> 6) & 63];
+    } else if (!(flags & LEV_BASE64_URL)) {
+      *out++ = '=';
+    }
+    if (!(flags & LEV_BASE64_URL)) {
+      *out++ = '=';
+    }
+  }
+  return (size_t)(out - dst);
+}
+
+/* input length once the '=' padding is gone, or (size_t)-1 */
+static size_t base64_unpadded(const unsigned char *src, size_t len) {
+  size_t n = len;
+
+  if (n && src[n - 1] == '=') {
+    n--;
+    if (n && src[n - 1] == '=') {
+      n--;
+    }
+    if (len % 4) {
+      return (size_t)-1; /* padded input comes in whole quads */
+    }
+  }
+  return n % 4 == 1 ? (size_t)-1 : n;
+}
+
+size_t lev_base64_decoded_len(const unsigned char *src, size_t len) {
+  size_t n = base64_unpadded(src, len);
+
+  if (n == (size_t)-1) {
+    return n;
+  }
+  return n / 4 * 3 + (n % 4 ? n % 4 - 1 : 0);
+}
+
+/* both alphabets are accepted with or without padding */
+int lev_base64_decode(unsigned char *dst, const unsigned char *src, size_t len, int flags) {
+  const unsigned char *values;
+  unsigned char a, b, c = 0;
+  size_t n = base64_unpadded(src, len);
+  size_t done;
+
+  if (n == (size_t)-1) {
+    return -1;
+  }
+  done = CODEC_KERNEL()->base64_decode(dst, src, n, flags);
+  done += base64_decode_generic(dst + done / 4 * 3, src + done, n - done, flags);
+  if (n - done >= 4) {
+    return -1; /* stopped early on a byte outside the alphabet */
+  }
+  if (n == done) {
+    return 0;
+  }
+
+  values = (flags & LEV_BASE64_URL) ? base64_url_values : base64_std_values;
+  dst += done / 4 * 3;
+  a = values[src[done]];
+  b = values[src[done + 1]];
+  if (n - done == 3) {
+    c = values[src[done + 2]];
+  }
+  if ((a | b | c) == 0xff) {
+    return -1;
+  }
+  *dst++ = (unsigned char)(a << 2 | b >> 4);
+  if (n - done == 3) {
+    *dst = (unsigned char)(b << 4 | c >> 2);
+  }
+  return 0;
+}
+
+/* X:E base64 */
@@ -0,0 +1,50 @@
+/*
+ *  Copyright 2012 connectFree k.k. and the lev authors. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef _LEV_CODEC_H_
+#define _LEV_CODEC_H_
+
+#include <stddef.h>
+
+/*
+  hex and base64 (RFC 4648, standard and URL-safe alphabets) for
+  lev.buffer. like lev_search the kernel (generic, SSE2 or SSSE3) is
+  picked once from the running CPU; LEV_CODEC_KERNEL or
+  lev_codec_set_kernel() can force one for benchmarking.
+*/
+
+#define LEV_BASE64_URL 1 /* '-' and '_' instead of '+' and '/', no '=' padding */
+
+#define lev_hex_encoded_len(n) ((n) * 2)
+size_t lev_base64_encoded_len(size_t n, int flags);
+
+/* exact output size, or (size_t)-1 when len cannot be valid input */
+size_t lev_hex_decoded_len(size_t len);
+size_t lev_base64_decoded_len(const unsigned char *src, size_t len);
+
+const char *lev_codec_kernel_name();
+int lev_codec_set_kernel(const char *name);
+
+/* encoders cannot fail and return the bytes written */
+size_t lev_hex_encode(unsigned char *dst, const unsigned char *src, size_t len, int upper);
+size_t lev_base64_encode(unsigned char *dst, const unsigned char *src, size_t len, int flags);
+
+/* decoders write *_decoded_len() bytes and return 0, or -1 on invalid input */
+int lev_hex_decode(unsigned char *dst, const unsigned char *src, size_t len);
+int lev_base64_decode(unsigned char *dst, const unsigned char *src, size_t len, int flags);
+
+#endif
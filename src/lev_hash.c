@@ -0,0 +1,360 @@
+/*
+ *  Copyright 2012 connectFree k.k. and the lev authors. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "lev_hash.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && \
+    (defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+  #define LEV_HASH_SSE42 /* compiled per function, used only if the CPU has it */
+  #include <nmmintrin.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define HASH_HOST_BIG 1
+#else
+#define HASH_HOST_BIG 0
+#endif
+
+/* X:S zlib */
+
+/* zlib takes uInt lengths, so feed it at most 1G at a time */
+#define HASH_ZLIB_CHUNK ((size_t)1 << 30)
+
+uint32_t lev_crc32(uint32_t crc, const unsigned char *src, size_t len) {
+  size_t n;
+
+  while (len) {
+    n = len < HASH_ZLIB_CHUNK ? len : HASH_ZLIB_CHUNK;
+    crc = (uint32_t)crc32(crc, src, (uInt)n);
+    src += n;
+    len -= n;
+  }
+  return crc;
+}
+
+uint32_t lev_adler32(uint32_t adler, const unsigned char *src, size_t len) {
+  size_t n;
+
+  while (len) {
+    n = len < HASH_ZLIB_CHUNK ? len : HASH_ZLIB_CHUNK;
+    adler = (uint32_t)adler32(adler, src, (uInt)n);
+    src += n;
+    len -= n;
+  }
+  return adler;
+}
+
+/* X:E zlib */
+
+/* X:S crc32c */
+
+#define CRC32C_POLY 0x82f63b78 /* Castagnoli, reflected */
+
+/* slicing-by-8 tables; built on first use */
+static uint32_t crc32c_table[8][256];
+
+static void _lev_hash_tables() {
+  static int built = 0;
+  uint32_t crc;
+  int i, j;
+
+  if (built) {
+    return;
+  }
+  for (i = 0; i < 256; i++) {
+    crc = i;
+    for (j = 0; j < 8; j++) {
+      crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+    }
+    crc32c_table[0][i] = crc;
+  }
+  for (i = 0; i < 256; i++) {
+    crc = crc32c_table[0][i];
+    for (j = 1; j < 8; j++) {
+      crc = crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+      crc32c_table[j][i] = crc;
+    }
+  }
+  built = 1;
+}
+
+/* kernels take and return the raw (inverted) register */
+typedef uint32_t (*crc32c_fn)(uint32_t, const unsigned char *, size_t);
+
+static uint32_t crc32c_generic(uint32_t crc, const unsigned char *src, size_t len) {
+  uint32_t lo, hi;
+
+  while (len && ((uintptr_t)src & 7)) {
+    crc = crc32c_table[0][(crc ^ *src++) & 0xff] ^ (crc >> 8);
+    len--;
+  }
+  while (len >= 8) {
+    memcpy(&lo, src, 4);
+    memcpy(&hi, src + 4, 4);
+#if HASH_HOST_BIG
+    lo = __builtin_bswap32(lo);
+    hi = __builtin_bswap32(hi);
+#endif
+    lo ^= crc;
+    crc = crc32c_table[7][lo & 0xff] ^ crc32c_table[6][(lo >> 8) & 0xff]
+        ^ crc32c_table[5][(lo >> 16) & 0xff] ^ crc32c_table[4][lo >> 24]
+        ^ crc32c_table[3][hi & 0xff] ^ crc32c_table[2][(hi >> 8) & 0xff]
+        ^ crc32c_table[1][(hi >> 16) & 0xff] ^ crc32c_table[0][hi >> 24];
+    src += 8;
+    len -= 8;
+  }
+  while (len--) {
+    crc = crc32c_table[0][(crc ^ *src++) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#ifdef LEV_HASH_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *src, size_t len) {
+  uint64_t crc64, word;
+
+  while (len && ((uintptr_t)src & 7)) {
+    crc = _mm_crc32_u8(crc, *src++);
+    len--;
+  }
+  crc64 = crc;
+  while (len >= 8) {
+    memcpy(&word, src, 8);
+    crc64 = _mm_crc32_u64(crc64, word);
+    src += 8;
+    len -= 8;
+  }
+  crc = (uint32_t)crc64;
+  while (len--) {
+    crc = _mm_crc32_u8(crc, *src++);
+  }
+  return crc;
+}
+#endif
+
+/* X:E crc32c */
+
+/* X:S dispatch */
+
+static struct {
+  const char *name;
+  crc32c_fn crc32c;
+} hash_kernels[] = {
+   { "generic", crc32c_generic }
+#ifdef LEV_HASH_SSE42
+  ,{ "sse4.2",  crc32c_sse42   }
+#endif
+};
+
+#define HASH_KERNEL_COUNT (int)(sizeof(hash_kernels) / sizeof(hash_kernels[0]))
+
+static int hash_kernel = -1;
+
+static int _lev_hash_supported(int i) {
+#ifdef LEV_HASH_SSE42
+  if (hash_kernels[i].crc32c == crc32c_sse42) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+  }
+#endif
+  return 1;
+}
+
+static void _lev_hash_init() {
+  int i;
+
+  if (lev_hash_set_kernel(getenv("LEV_HASH_KERNEL")) == 0) {
+    return;
+  }
+  for (i = HASH_KERNEL_COUNT - 1; i > 0 && !_lev_hash_supported(i); i--)
+    ;
+  hash_kernel = i; /* the best one this CPU runs */
+}
+
+#define HASH_KERNEL() \
+  (hash_kernel < 0 ? _lev_hash_init() : (void)0, &hash_kernels[hash_kernel])
+
+/* returns -1 if name is unknown or this CPU cannot run it */
+int lev_hash_set_kernel(const char *name) {
+  int i;
+
+  _lev_hash_tables();
+  if (!name) {
+    return -1;
+  }
+  for (i = 0; i < HASH_KERNEL_COUNT; i++) {
+    if (!strcmp(name, hash_kernels[i].name) && _lev_hash_supported(i)) {
+      hash_kernel = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+const char *lev_hash_kernel_name() {
+  return HASH_KERNEL()->name;
+}
+
+uint32_t lev_crc32c(uint32_t crc, const unsigned char *src, size_t len) {
+  return ~HASH_KERNEL()->crc32c(~crc, src, len);
+}
+
+/* X:E dispatch */
+
+/* X:S xxh64 */
+
+#define XXH_P1 0x9e3779b185ebca87ULL
+#define XXH_P2 0xc2b2ae3d27d4eb4fULL
+#define XXH_P3 0x165667b19e3779f9ULL
+#define XXH_P4 0x85ebca77c2b2ae63ULL
+#define XXH_P5 0x27d4eb2f165667c5ULL
+
+#define XXH_ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static uint64_t xxh_read64(const unsigned char *p) {
+  uint64_t v;
+
+  memcpy(&v, p, 8);
+#if HASH_HOST_BIG
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+static uint32_t xxh_read32(const unsigned char *p) {
+  uint32_t v;
+
+  memcpy(&v, p, 4);
+#if HASH_HOST_BIG
+  v = __builtin_bswap32(v);
+#endif
+  return v;
+}
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input) {
+  acc += input * XXH_P2;
+  acc = XXH_ROTL(acc, 31);
+  return acc * XXH_P1;
+}
+
+static uint64_t xxh_merge(uint64_t acc, uint64_t v) {
+  acc ^= xxh_round(0, v);
+  return acc * XXH_P1 + XXH_P4;
+}
+
+/* whole 32 byte stripes; returns the bytes consumed */
+static size_t xxh_stripes(uint64_t *v, const unsigned char *p, size_t len) {
+  const unsigned char *start = p;
+  uint64_t v1 = v[0], v2 = v[1], v3 = v[2], v4 = v[3];
+
+  while (len >= 32) {
+    v1 = xxh_round(v1, xxh_read64(p));
+    v2 = xxh_round(v2, xxh_read64(p + 8));
+    v3 = xxh_round(v3, xxh_read64(p + 16));
+    v4 = xxh_round(v4, xxh_read64(p + 24));
+    p += 32;
+    len -= 32;
+  }
+  v[0] = v1; v[1] = v2; v[2] = v3; v[3] = v4;
+  return (size_t)(p - start);
+}
+
+void lev_xxh64_init(lev_xxh64_t *state, uint64_t seed) {
+  state->total = 0;
+  state->seed = seed;
+  state->v[0] = seed + XXH_P1 + XXH_P2;
+  state->v[1] = seed + XXH_P2;
+  state->v[2] = seed;
+  state->v[3] = seed - XXH_P1;
+  state->memsize = 0;
+}
+
+void lev_xxh64_update(lev_xxh64_t *state, const unsigned char *src, size_t len) {
+  size_t n;
+
+  state->total += len;
+  if (state->memsize) {
+    n = 32 - state->memsize;
+    if (len < n) {
+      memcpy(state->mem + state->memsize, src, len);
+      state->memsize += len;
+      return;
+    }
+    memcpy(state->mem + state->memsize, src, n);
+    xxh_stripes(state->v, state->mem, 32);
+    state->memsize = 0;
+    src += n;
+    len -= n;
+  }
+  n = xxh_stripes(state->v, src, len);
+  memcpy(state->mem, src + n, len - n);
+  state->memsize = len - n;
+}
+
+uint64_t lev_xxh64_digest(const lev_xxh64_t *state) {
+  const unsigned char *p = state->mem;
+  const unsigned char *end = p + state->memsize;
+  uint64_t h;
+
+  if (state->total >= 32) {
+    h = XXH_ROTL(state->v[0], 1) + XXH_ROTL(state->v[1], 7)
+      + XXH_ROTL(state->v[2], 12) + XXH_ROTL(state->v[3], 18);
+    h = xxh_merge(h, state->v[0]);
+    h = xxh_merge(h, state->v[1]);
+    h = xxh_merge(h, state->v[2]);
+    h = xxh_merge(h, state->v[3]);
+  } else {
+    h = state->seed + XXH_P5;
+  }
+  h += state->total;
+
+  while (p + 8 <= end) {
+    h ^= xxh_round(0, xxh_read64(p));
+    h = XXH_ROTL(h, 27) * XXH_P1 + XXH_P4;
+    p += 8;
+  }
+  if (p + 4 <= end) {
+    h ^= (uint64_t)xxh_read32(p) * XXH_P1;
+    h = XXH_ROTL(h, 23) * XXH_P2 + XXH_P3;
+    p += 4;
+  }
+  while (p < end) {
+    h ^= *p++ * XXH_P5;
+    h = XXH_ROTL(h, 11) * XXH_P1;
+  }
+
+  h ^= h >> 33;
+  h *= XXH_P2;
+  h ^= h >> 29;
+  h *= XXH_P3;
+  h ^= h >> 32;
+  return h;
+}
+
+uint64_t lev_xxh64(const unsigned char *src, size_t len, uint64_t seed) {
+  lev_xxh64_t state;
+
+  lev_xxh64_init(&state, seed);
+  lev_xxh64_update(&state, src, len);
+  return lev_xxh64_digest(&state);
+}
+
+/* X:E xxh64 */
@@ -0,0 +1,53 @@
+/*
+ *  Copyright 2012 connectFree k.k. and the lev authors. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef _LEV_HASH_H_
+#define _LEV_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  checksums and hashes over raw bytes for lev.buffer. crc32 and adler32
+  are zlib's; crc32c (Castagnoli, as in iSCSI, ext4 and leveldb) uses the
+  SSE4.2 crc32 instruction when the CPU has it, picked once like the
+  lev_codec kernels (LEV_HASH_KERNEL or lev_hash_set_kernel() force one);
+  xxh64 is XXH64. all of them can be fed in pieces.
+*/
+
+/* pass the previous result to continue; start with 0 (crc) or 1 (adler32) */
+uint32_t lev_crc32(uint32_t crc, const unsigned char *src, size_t len);
+uint32_t lev_crc32c(uint32_t crc, const unsigned char *src, size_t len);
+uint32_t lev_adler32(uint32_t adler, const unsigned char *src, size_t len);
+
+const char *lev_hash_kernel_name();
+int lev_hash_set_kernel(const char *name);
+
+typedef struct _lev_xxh64 {
+  uint64_t total;         /* bytes fed so far */
+  uint64_t seed;
+  uint64_t v[4];          /* the four lanes */
+  unsigned char mem[32];  /* a partial stripe */
+  size_t memsize;
+} lev_xxh64_t;
+
+void lev_xxh64_init(lev_xxh64_t *state, uint64_t seed);
+void lev_xxh64_update(lev_xxh64_t *state, const unsigned char *src, size_t len);
+uint64_t lev_xxh64_digest(const lev_xxh64_t *state);
+uint64_t lev_xxh64(const unsigned char *src, size_t len, uint64_t seed);
+
+#endif
@@ -108,6 +108,7 @@ static void print_usage(void)
   "  -c cores  Use upto these many " LUA_QL("cores") " \n"
   "  -e chunk  Execute string " LUA_QL("chunk") ".\n"
   "  -l name   Require library " LUA_QL("name") ".\n"
+  "  -s sizes  Slab size classes, e.g. " LUA_QL("1k:1024,2k,4k,8k:512") ".\n"
   "  -b ...    Save or list bytecode.\n"
   "  -j cmd    Perform LuaJIT control command.\n"
   "  -O[opt]   Control LuaJIT optimizations.\n"
@@ -497,6 +498,7 @@ static int collectargs(char **argv, int *flags)
       case 'j':  /* LuaJIT extension */
       case 'c':
       case 'l':
+      case 's':
         *flags |= FLAGS_OPTION;
         if (argv[i][2] == '\0') {
           i++;
@@ -533,6 +535,16 @@ static int runargs(lua_State *L, char **argv, int n) {
         core_count = atoi(core_number);
         break;
       }
+      case 's': {
+        const char *classes = argv[i] + 2;
+        if (*classes == '\0') {
+          classes = argv[++i];
+        }
+        lua_assert(classes != NULL);
+        /* picked up by lev_slab_fill(); workers inherit it through environ */
+        setenv("LEV_SLAB_CLASSES", classes, 1);
+        break;
+      }
       case 'e': {
         const char *chunk = argv[i] + 2;
         if (*chunk == '\0') chunk = argv[++i];
@@ -20,45 +20,107 @@
 #include "luv_debug.h"
 
 #include <errno.h>
+#include <stdlib.h> /* getenv */
 #include <string.h> /* memset */
 
-static char object_registry[0];
+static int object_registry = LUA_NOREF; /* weak table: lightuserdata -> object */
+
+/*
+  reads land in _static_mb, a slab block shared by every handle: each read
+  is handed to Lua as a slice of it (no copy) and the next one goes right
+  behind, until the block cannot hold another read and a fresh one is
+  taken. _static_mb holds a reference of its own while it is being filled.
+
+  how much a read may take is per handle (lev_readsize_t, behind
+  handle->data once reading starts): it doubles whenever a read fills all
+  the space offered, up to read_max, and halves after a few reads in a row
+  that used under a quarter of it, down to read_min. bulk transfers get
+  64k per syscall and callback; chatty handles stop taking 8k each time.
+  handles without one (udp) read STATIC_MB_SIZE at a time.
+
+  lev.reads.stats() reports how that is doing; LEV_READ_MIN / LEV_READ_MAX
+  (or lev.reads.configure({ min =, max = })) bound it, and equal bounds
+  turn it into fixed size reads.
+*/
 static MemBlock *_static_mb = NULL;
+static lev_readsize_t *_reading = NULL; /* the handle on_alloc last served */
+static size_t _offered = 0;
+static size_t read_min = LEV_READ_MIN;
+static size_t read_max = LEV_READ_MAX;
+static lev_read_stats_t read_stats;
 
 #define STATIC_MB_SIZE   8192
 
 uv_buf_t on_alloc(uv_handle_t* handle, size_t suggested_size) {
   uv_buf_t buf;
-  size_t size = STATIC_MB_SIZE;
+  lev_readsize_t *rs = handle->data;
+  size_t size = rs ? rs->size : STATIC_MB_SIZE;
 
   if (_static_mb && _static_mb->size - _static_mb->nbytes < size) {
     lev_slab_decRef( _static_mb );
+    _static_mb = NULL;
+  }
+  if (!_static_mb) {
     _static_mb = lev_slab_getBlock( size );
-  } else if (!_static_mb){
-    _static_mb = lev_slab_getBlock( size );
+    lev_slab_incRef( _static_mb );
+    read_stats.blocks++;
   }
 
+  _reading = rs;
+  _offered = size;
   buf.base = (char *)(_static_mb->bytes + _static_mb->nbytes);
-  buf.len = _static_mb->size - _static_mb->nbytes;
+  buf.len = size;
   return buf;
 }
 
+static void _lev_readsize_adapt(lev_readsize_t *rs, size_t offered, int nread) {
+  if (nread <= 0) {
+    return;
+  }
+  read_stats.reads++;
+  read_stats.bytes += nread;
+  if ((size_t)nread == offered) {
+    read_stats.full++;
+  }
+  if (!rs) {
+    return;
+  }
+
+  rs->reads++;
+  rs->bytes += nread;
+  if ((size_t)nread == offered) {
+    rs->small = 0;
+    if (rs->size < read_max) {
+      rs->size = rs->size * 2 < read_max ? rs->size * 2 : read_max;
+      rs->grows++;
+      read_stats.grows++;
+    }
+  } else if ((size_t)nread * 4 <= rs->size) {
+    if (++rs->small >= LEV_READ_SHRINK_AFTER && rs->size > read_min) {
+      rs->size = rs->size / 2 > read_min ? rs->size / 2 : read_min;
+      rs->small = 0;
+      rs->shrinks++;
+      read_stats.shrinks++;
+    }
+  } else {
+    rs->small = 0;
+  }
+}
+
 /* this will ALWAYS be called after on_alloc */
 void lev_pushbuffer_from_static_mb(lua_State *L, int nread) {
-  MemBlock *mb = NULL;
+  MemBlock *mb = _static_mb;
+  MemSlice *ms;
 
-  mb = _static_mb;
-  if (STATIC_MB_SIZE != _static_mb->size) {
-    lev_slab_incRef( _static_mb );
-  } else { /* we completely own this MemBlock, no need to give it to others */
-    _static_mb = NULL;
-  }
+  _lev_readsize_adapt(_reading, _offered, nread);
+  _reading = NULL;
 
   if (-1 == nread) {
-    if (!_static_mb) {/* we own this mb -- dispose of it */
-      lev_slab_incRef( mb );
-      lev_slab_decRef( mb );
-    }
+    return; /* nothing was read; the block stays for the next one */
+  }
+  if (0 == nread) {
+    ms = lev_buffer_new(L, 0, NULL, 0);
+    lev_buffer_set_length(ms, 0);
     return;
   }
 
@@ -70,10 +132,113 @@ void lev_pushbuffer_from_static_mb(lua_State *L, int nread) {
       ,mb->bytes + mb->nbytes
     ); /* automatically incRef's mb */
   mb->nbytes += nread; /* consume nread bytes */
+
+  if (mb->size - mb->nbytes < read_min) { /* no room for another read: the buffers own it now */
+    lev_slab_decRef( mb );
+    _static_mb = NULL;
+  }
+}
+
+/* called by read_start: size reads for this handle from now on */
+void lev_readsize_start(uv_handle_t *handle, lev_readsize_t *rs) {
+  if (!rs->size) {
+    rs->size = STATIC_MB_SIZE;
+  }
+  if (rs->size < read_min) {
+    rs->size = read_min;
+  } else if (rs->size > read_max) {
+    rs->size = read_max;
+  }
+  handle->data = rs;
+}
+
+/* { size = ..., reads = ..., bytes = ..., grows = ..., shrinks = ... } */
+void lev_readsize_push(lua_State *L, lev_readsize_t *rs) {
+  lua_createtable(L, 0, 5);
+  LEV_SET_FIELD(size, number, rs->size);
+  LEV_SET_FIELD(reads, number, rs->reads);
+  LEV_SET_FIELD(bytes, number, rs->bytes);
+  LEV_SET_FIELD(grows, number, rs->grows);
+  LEV_SET_FIELD(shrinks, number, rs->shrinks);
 }
 
+/* X:S lev.reads */
+
+/* change the bounds; 0 leaves one as it is */
+static void reads_bounds(size_t min, size_t max) {
+  if (min) {
+    read_min = min;
+  }
+  if (max) {
+    read_max = max;
+  }
+  if (read_max < read_min) {
+    read_max = read_min;
+  }
+}
+
+/*
+  stats() -> { reads = ..., bytes = ..., full = ..., grows = ..., ... }
+  every stream read so far; full reads filled all the space offered.
+*/
+static int reads_stats(lua_State* L) {
+  lua_createtable(L, 0, 8);
+  LEV_SET_FIELD(reads, number, read_stats.reads);
+  LEV_SET_FIELD(bytes, number, read_stats.bytes);
+  LEV_SET_FIELD(full, number, read_stats.full);
+  LEV_SET_FIELD(grows, number, read_stats.grows);
+  LEV_SET_FIELD(shrinks, number, read_stats.shrinks);
+  LEV_SET_FIELD(blocks, number, read_stats.blocks);
+  LEV_SET_FIELD(min, number, read_min);
+  LEV_SET_FIELD(max, number, read_max);
+
+  return 1;
+}
+
+/* configure({ min = bytes, max = bytes }) -- applies to read_start from now on */
+static int reads_configure(lua_State* L) {
+  size_t min, max;
+
+  luaL_checktype(L, 1, LUA_TTABLE);
+
+  lua_getfield(L, 1, "min");
+  min = (size_t)luaL_optinteger(L, -1, 0);
+  lua_getfield(L, 1, "max");
+  max = (size_t)luaL_optinteger(L, -1, 0);
+  reads_bounds(min, max);
+  lua_pop(L, 2);
+
+  return 0;
+}
+
+static luaL_reg reads_functions[] = {
+   { "stats",     reads_stats     }
+  ,{ "configure", reads_configure }
+  ,{ NULL, NULL }
+};
+
+static void luaopen_lev_reads(lua_State *L) {
+  size_t min = 0, max = 0;
+  const char *env;
+
+  env = getenv("LEV_READ_MIN");
+  if (env) {
+    min = (size_t)atol(env);
+  }
+  env = getenv("LEV_READ_MAX");
+  if (env) {
+    max = (size_t)atol(env);
+  }
+  reads_bounds(min, max);
+
+  lua_createtable(L, 0, ARRAY_SIZE(reads_functions) - 1);
+  luaL_register(L, NULL, reads_functions);
+  lua_setfield(L, -2, "reads");
+}
+
+/* X:E lev.reads */
+
 static void create_object_registry(lua_State* L) {
-  lua_pushlightuserdata(L, object_registry);
   lua_newtable(L);
 
   lua_createtable(L, 0, 1);
@@ -81,7 +246,7 @@ static void create_object_registry(lua_State* L) {
   lua_setfield(L, -2, "__mode");
 
   lua_setmetatable(L, -2);
-  lua_rawset(L, LUA_REGISTRYINDEX);
+  object_registry = luaL_ref(L, LUA_REGISTRYINDEX);
 }
 
 void* new_object(lua_State* L, size_t size, const char* clazz) {
@@ -92,8 +257,8 @@ void* new_object(lua_State* L, size_t size, const char* clazz) {
   luaL_getmetatable(L, clazz);
   lua_setmetatable(L, -2);
 
-  /* Create storage for callbacks. */
-  lua_createtable(L, 1, 0);
+  /* Create storage for callbacks, one array slot per LEV_CB_*. */
+  lua_createtable(L, LEV_CB_MAX - 1, 0);
   lua_setfenv(L, -2);
 
   push_registry(L);
@@ -109,39 +274,42 @@ void* new_object(lua_State* L, size_t size, const char* clazz) {
   return object;
 }
 
-void set_callback(lua_State* L, const char* name, int index) {
+void set_callback(lua_State* L, int slot, int index) {
   index = abs_index(L, index);
   luaL_checktype(L, index, LUA_TFUNCTION);
 
   lua_getfenv(L, 1);
-  lua_pushstring(L, name);
   lua_pushvalue(L, index);
-  lua_rawset(L, -3);
+  lua_rawseti(L, -2, slot);
   lua_pop(L, 1);
 }
 
 
-void clear_callback(lua_State* L, const char* name, void* object) {
+void clear_callback(lua_State* L, int slot, void* object) {
   push_object(L, object);
   lua_getfenv(L, -1);
-  lua_pushstring(L, name);
   lua_pushnil(L);
-  lua_rawset(L, -3);
+  lua_rawseti(L, -2, slot);
   lua_pop(L, 2);
 }
 
 void push_registry(lua_State* L) {
   /* Push our object registry onto the stack. */
-  lua_pushlightuserdata(L, object_registry);
-  lua_rawget(L, LUA_REGISTRYINDEX);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, object_registry);
   assert(lua_istable(L, -1));
 }
 
 void push_object(lua_State* L, void* object) {
+  LevRefStruct_t *self = (LevRefStruct_t *)object;
+
+  /* an active object holds a strong ref to itself; no hash lookup needed */
+  if (self->ref != LUA_NOREF) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, self->ref);
+    return;
+  }
+
   /* Push our object registry onto the stack. */
-  lua_pushlightuserdata(L, object_registry);
-  lua_rawget(L, LUA_REGISTRYINDEX);
-  assert(lua_istable(L, -1));
+  push_registry(L);
 
   /* Look up the Lua object associated with this handle. */
   lua_pushlightuserdata(L, object);
@@ -152,23 +320,22 @@ void push_object(lua_State* L, void* object) {
   /* STACK: <object> */
 }
 
-int _push_callback(lua_State* L, void* object, const char* name, int pop_object) {
+int _push_callback(lua_State* L, void* object, int slot, int pop_object) {
 
   push_object(L, object);
 
   /* Get the callback table. */
   lua_getfenv(L, -1);
 /*
-  printf("push_callback: %s (%d)\n", name, lua_type(L, (-1)) );
+  printf("push_callback: %d (%d)\n", slot, lua_type(L, (-1)) );
   luv_lua_debug_stackdump(L, "push_callback");
 */
   assert(lua_istable(L, -1));
 
   /* Look up callback. */
-  lua_pushstring(L, name);
-  lua_rawget(L, -2);
+  lua_rawgeti(L, -1, slot);
   if (!lua_isfunction(L, -1)) {
-    lua_pop(L, -2); /* no callback registered; cleanup */
+    lua_pop(L, 3); /* no callback registered; cleanup */
     return 0;
   }
 
@@ -341,6 +508,7 @@ int luaopen_levbase(lua_State *L) {
   lev_slab_fill();
 
   luaL_register(L, "lev", functions);
+  luaopen_lev_reads(L); /* lev.reads */
   luaopen_lev_fs(L); /* lev.fs */
   luaopen_lev_net(L); /* lev.net */
   luaopen_lev_dns(L); /* lev.dns */
@@ -352,8 +520,12 @@ int luaopen_levbase(lua_State *L) {
   luaopen_lev_mpack(L); /* lev.mpack */
   luaopen_lev_timer(L); /* lev.timer */
   luaopen_lev_buffer(L); /* lev.buffer */
+  luaopen_lev_bufferlist(L); /* lev.bufferlist */
+  luaopen_lev_bufferwriter(L); /* lev.bufferwriter */
+  luaopen_lev_zlib(L); /* lev.zlib */
   luaopen_lev_process(L); /* lev.process */
   luaopen_lev_signal(L); /* lev.signal */
+  luaopen_lev_slab(L); /* lev.slab */
 
   return 1;
 }
@@ -37,8 +37,34 @@
 #define ARRAY_SIZE(a) (sizeof((a)) / sizeof((a)[0]))
 
 /* X:S network + buffer support */
+#define LEV_READ_MIN          1024  /* smallest read a chatty handle shrinks to */
+#define LEV_READ_MAX          65536 /* largest read a streaming handle grows to */
+#define LEV_READ_SHRINK_AFTER 4     /* reads in a row using under a quarter of the size */
+
+/* adaptive read sizing for a handle; handle->data points here while reading */
+typedef struct _lev_readsize {
+  size_t size;    /* what on_alloc hands out next; 0 until the first read_start */
+  int small;      /* reads in a row that used under a quarter of size */
+  size_t reads;
+  size_t bytes;
+  size_t grows;
+  size_t shrinks;
+} lev_readsize_t;
+
+/* process wide, over every read through on_alloc */
+typedef struct _lev_read_stats {
+  size_t reads;
+  size_t bytes;
+  size_t full;    /* reads that filled all the space offered */
+  size_t grows;
+  size_t shrinks;
+  size_t blocks;  /* slab blocks taken for reading */
+} lev_read_stats_t;
+
 uv_buf_t on_alloc(uv_handle_t* handle, size_t suggested_size);
 void lev_pushbuffer_from_static_mb(lua_State *L, int nread);
+void lev_readsize_start(uv_handle_t *handle, lev_readsize_t *rs);
+void lev_readsize_push(lua_State *L, lev_readsize_t *rs);
 /* X:E network + buffer support */
 
 typedef struct _LevRefStruct {
@@ -62,42 +88,80 @@ void luaopen_lev_pipe(lua_State *L); /* lev.pipe */
 void luaopen_lev_mpack(lua_State *L); /* lev.mpack */
 void luaopen_lev_timer(lua_State *L); /* lev.timer */
 void luaopen_lev_buffer(lua_State *L); /* lev.buffer */
+void luaopen_lev_bufferlist(lua_State *L); /* lev.bufferlist */
+void luaopen_lev_bufferwriter(lua_State *L); /* lev.bufferwriter */
+void luaopen_lev_zlib(lua_State *L); /* lev.zlib */
 void luaopen_lev_signal(lua_State *L); /* lev.signal */
+void luaopen_lev_slab(lua_State *L); /* lev.slab */
 void luaopen_lev_process(lua_State *L); /* lev.process */
 
 /* X:S buffer helper functions */
 int lev_pushbuffer_from_mb(lua_State *L, MemBlock *mb, size_t until, unsigned char *slice);
 uv_buf_t lev_buffer_to_uv(lua_State *L, int index);
 MemSlice * lev_buffer_new(lua_State *L, size_t size, const char *temp, size_t temp_size);
+void lev_buffer_set_length(MemSlice *ms, size_t until);
+void lev_buffer_track(int on);
+int lev_buffer_sweep();
+size_t lev_buffer_tracked();
 #define lev_checkbuffer(L, index) \
     ((MemSlice *)luaL_checkudata((L), (index), "lev.buffer"))
 
 size_t lev_memblock_empty_length(MemBlock *mb);
 size_t lev_memslice_empty_length(MemSlice *ms);
-void lev_memslice_resize(MemSlice *ms, size_t size);
-void lev_memslice_ensure_empty_length(MemSlice *ms, int len);
+int lev_memslice_resize(MemSlice *ms, size_t size);
+int lev_memslice_ensure_empty_length(MemSlice *ms, int len);
 void lev_memslice_append_char_unsafe(MemSlice *ms, size_t at, const char c);
 void lev_memslice_ensure_null(MemSlice *ms, size_t at);
-void lev_memslice_append_char(MemSlice *ms, size_t at, const char c);
-void lev_memslice_append_mem(MemSlice *ms, size_t from, const char *c, size_t len);
+int lev_memslice_append_char(MemSlice *ms, size_t at, const char c);
+int lev_memslice_append_mem(MemSlice *ms, size_t from, const char *c, size_t len);
 char *lev_memslice_empty_ptr(MemSlice *ms, size_t from);
 void lev_memslice_append_mem_unsafe(MemSlice *ms, size_t from, const char *c, size_t len);
 size_t lev_memslice_append_string(MemSlice *ms, size_t from, const char *str);
 /* X:E buffer helper functions */
 
+/* X:S bufferlist helper functions */
+typedef struct _lev_bufferlist lev_bufferlist_t;
+
+/* a write request carrying its own iovec; see lev_bufferlist_writev() */
+typedef struct {
+  uv_write_t req;
+  int bufcnt;
+  uv_buf_t *bufs;
+  MemBlock **mbs;
+} lev_writev_t;
+
+lev_bufferlist_t *lev_tobufferlist(lua_State *L, int index);
+lev_writev_t *lev_bufferlist_writev(lua_State *L, lev_bufferlist_t *bl);
+void lev_writev_done(lev_writev_t *w);
+/* X:E bufferlist helper functions */
+
 void lev__init_start_time();
 
+/* callback slots in an object's fenv table */
+enum {
+   LEV_CB_CLOSE = 1
+  ,LEV_CB_CONNECT
+  ,LEV_CB_CONNECTION
+  ,LEV_CB_READ
+  ,LEV_CB_RECV
+  ,LEV_CB_TIMER
+  ,LEV_CB_REQUEST /* completion of a one-shot fs / dns request */
+  ,LEV_CB_DRAIN   /* write queue fell back below the low-water mark */
+  ,LEV_CB_MAX
+};
+
 void* new_object(lua_State* L, size_t size, const char* clazz);
-void set_callback(lua_State* L, const char* name, int index);
-void clear_callback(lua_State* L, const char* name, void* object);
+void set_callback(lua_State* L, int slot, int index);
+void clear_callback(lua_State* L, int slot, void* object);
 void push_registry(lua_State* L);
+/* object must start with LEVBASE_REF_FIELDS (see create_obj_init_ref) */
 void push_object(lua_State* L, void* object);
 
-int _push_callback(lua_State* L, void* object, const char* name, int pop_object);
+int _push_callback(lua_State* L, void* object, int slot, int pop_object);
 /* push regular callback (with object */
-#define push_callback(L, object, name)  _push_callback(L, object, name, 0)
+#define push_callback(L, object, slot)  _push_callback(L, object, slot, 0)
 /* push callback without object */
-#define push_callback_no_obj(L, object, name)  _push_callback(L, object, name, 1)
+#define push_callback_no_obj(L, object, slot)  _push_callback(L, object, slot, 1)
 
 /* Loop register/retrive functions */
 void lev_set_loop(lua_State *L, uv_loop_t *loop);
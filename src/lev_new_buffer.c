@@ -16,6 +16,10 @@
  */
 
  #include "lev_new_base.h"
+#include "lev_search.h"
+#include "lev_pack.h"
+#include "lev_codec.h"
+#include "lev_hash.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -76,50 +80,14 @@ static uint16_t __builtin_bswap16( uint16_t a ) {
 
 /******************************************************************************/
 
-/* Mac OS X < 10.7.x has no "memmem" */
-#if !((!defined(__GNUC__) || __GNUC__ >= 2) && !defined(__APPLE__))
-#undef memmem
-/* memmem implementation from fbsd */
-/* Copyright (c) 2005 Pascal Gloor <pascal.gloor@spale.com> */
-/* http://opensource.apple.com/source/Libc/Libc-763.12/string/memmem-fbsd.c */
-static void *my_memmem(l, l_len, s, s_len)
-  const void *l; size_t l_len;
-  const void *s; size_t s_len;
-{
-  register char *cur, *last;
-  const char *cl = (const char *)l;
-  const char *cs = (const char *)s;
-
-  /* we need something to compare */
-  if (l_len == 0 || s_len == 0) {
-    return NULL;
-  }
-
-  /* "s" must be smaller or equal to "l" */
-  if (l_len < s_len) {
-    return NULL;
-  }
-
-  /* special case where s_len == 1 */
-  if (s_len == 1) {
-    return memchr(l, (int)*cs, l_len);
-  }
+#define BUFFER_NEEDLE_UDATA(L, index) \
+  ((lev_needle_t *)luaL_checkudata(L, index, "lev.needle"))
 
-  /* the last position where its possible to find "s" in "l" */
-  last = (char *)cl + l_len - s_len;
+#define BUFFER_FORMAT_UDATA(L, index) \
+  ((lev_pack_plan_t *)luaL_checkudata(L, index, "lev.format"))
 
-  for (cur = (char *)cl; cur <= last; cur++) {
-    if (cur[0] == cs[0] && memcmp(cur, cs, s_len) == 0) {
-      return cur;
-    }
-  }
-
-  return NULL;
-}
-
-#define memmem my_memmem
-
-#endif
+#define BUFFER_HASHER_UDATA(L, index) \
+  ((buffer_hasher_t *)luaL_checkudata(L, index, "lev.hasher"))
 
 /******************************************************************************/
 
@@ -150,15 +118,264 @@ MemSlice *lev_checkbufobj(lua_State *L, int index) {
   return ms;
 }
 
+/*
+  buffers never have callbacks and are never looked up from C by address,
+  so unlike handles they skip new_object()'s callback fenv table and weak
+  registry entry: a buffer costs a single Lua allocation.
+*/
+static MemSlice *lev_buffer_alloc(lua_State *L) {
+  MemSlice *ms;
+
+  ms = (MemSlice *)lua_newuserdata(L, sizeof *ms);
+  ms->pinned = 0;
+  luaL_getmetatable(L, "lev.buffer");
+  lua_setmetatable(L, -2);
+  return ms;
+}
+
+/*
+  slice retention. every buffer adds its length to the MemBlock's sliced
+  count (lev_slab_slice), so a block that is mostly invisible -- an 8k
+  read chunk kept alive by a 20 byte header slice -- shows up in
+  lev.slab.retention() and can be compacted.
+
+  with a compaction policy (lev_buffer_track) small slices of much larger
+  blocks are also remembered in an open addressing set; lev_buffer_sweep()
+  moves the ones that survived a whole period into right-sized blocks.
+  the set costs nothing while the policy is off.
+*/
+
+#define BUFFER_COMPACT_MAX   4096 /* only slices up to this size are moved automatically */
+#define BUFFER_COMPACT_RATIO 4    /* ...and only off blocks at least this much bigger than what is visible */
+
+typedef struct {
+  MemSlice *ms;         /* NULL: empty; BUFFER_TOMBSTONE: removed */
+  unsigned int epoch;   /* sweep period the slice was created in */
+} buffer_tracked_t;
+
+#define BUFFER_TOMBSTONE ((MemSlice *)1)
+
+static buffer_tracked_t *tracked = NULL;
+static size_t tracked_cap = 0;   /* power of two */
+static size_t tracked_count = 0; /* live entries */
+static size_t tracked_used = 0;  /* live entries and tombstones */
+static unsigned int tracked_epoch = 0;
+static int tracking = 0;
+
+#define TRACKED_SLOT(ms) ((((uintptr_t)(ms) >> 3) * 2654435761u) & (tracked_cap - 1))
+
+static void _buffer_track_insert(MemSlice *ms, unsigned int epoch);
+
+static void _buffer_track_rehash(size_t cap) {
+  buffer_tracked_t *old = tracked;
+  size_t old_cap = tracked_cap;
+  size_t i;
+
+  tracked = calloc(cap, sizeof(buffer_tracked_t));
+  if (!tracked) {
+    tracked = old; /* keep going without growing; inserts give up when full */
+    return;
+  }
+  tracked_cap = cap;
+  tracked_count = 0;
+  tracked_used = 0;
+  for (i = 0; i < old_cap; i++) {
+    if (old[i].ms && old[i].ms != BUFFER_TOMBSTONE) {
+      _buffer_track_insert(old[i].ms, old[i].epoch);
+    }
+  }
+  free(old);
+}
+
+static void _buffer_track_insert(MemSlice *ms, unsigned int epoch) {
+  size_t i;
+
+  if ((tracked_used + 1) * 4 > tracked_cap * 3) {
+    _buffer_track_rehash(tracked_count * 2 > tracked_cap / 2 ? tracked_cap * 2 : (tracked_cap ? tracked_cap : 64));
+    if ((tracked_used + 1) * 4 > tracked_cap * 3) {
+      return;
+    }
+  }
+  for (i = TRACKED_SLOT(ms); tracked[i].ms && tracked[i].ms != BUFFER_TOMBSTONE; i = (i + 1) & (tracked_cap - 1))
+    ;
+  if (!tracked[i].ms) {
+    tracked_used++;
+  }
+  tracked[i].ms = ms;
+  tracked[i].epoch = epoch;
+  tracked_count++;
+}
+
+static void _buffer_track_remove(MemSlice *ms) {
+  size_t i;
+
+  for (i = TRACKED_SLOT(ms); tracked[i].ms; i = (i + 1) & (tracked_cap - 1)) {
+    if (tracked[i].ms == ms) {
+      tracked[i].ms = BUFFER_TOMBSTONE;
+      tracked_count--;
+      return;
+    }
+  }
+}
+
+/* account for a new buffer; remember it if the policy might move it later */
+static void _buffer_retain(MemSlice *ms) {
+  lev_slab_slice(ms->mb, ms->until);
+  if (tracking && ms->until && ms->until <= BUFFER_COMPACT_MAX
+      && ms->until * BUFFER_COMPACT_RATIO <= ms->mb->size) {
+    _buffer_track_insert(ms, tracked_epoch);
+  }
+}
+
+static void _buffer_release(MemSlice *ms) {
+  if (tracked_count) {
+    _buffer_track_remove(ms);
+  }
+  lev_slab_slice(ms->mb, -(long)ms->until);
+  lev_slab_decRef(ms->mb);
+}
+
+/* change the length of a buffer that is already accounted for */
+void lev_buffer_set_length(MemSlice *ms, size_t until) {
+  lev_slab_slice(ms->mb, (long)until - (long)ms->until);
+  ms->until = until;
+}
+
+/*
+  lev_memslice_append_mem for a lev.buffer. growing may move the bytes to
+  another block (or mremap the one they are on), so its sliced count
+  goes with them; a pinned buffer cannot grow at all.
+*/
+static void _buffer_append_mem(lua_State *L, MemSlice *ms, size_t from, const char *c, size_t len) {
+  if (from + len > lev_memslice_empty_length(ms)) {
+    if (ms->pinned) {
+      luaL_error(L, "cannot grow a buffer pinned by ptr()");
+    }
+    lev_slab_slice(ms->mb, -(long)ms->until);
+    if (lev_memslice_resize(ms, from + len)) {
+      lev_slab_slice(ms->mb, ms->until);
+      luaL_error(L, "cannot grow a buffer to %d bytes", (int)(from + len));
+    }
+    lev_slab_slice(ms->mb, ms->until);
+  }
+  memcpy(ms->slice + from, c, len);
+}
+
+/*
+  size bytes for a new buffer: small ones are packed back to back into the
+  shared _static_mb, large ones get a block of their own. returns the block
+  (without a reference for the caller) and sets *slice, or NULL.
+*/
+static MemBlock *_buffer_carve(size_t size, unsigned char **slice) {
+  MemBlock *mb;
+
+  if (size > lev_slab_largest_class()) {
+    /* large objects get their own extent and never become the shared _static_mb */
+    mb = lev_slab_getBlock( size );
+    if (!mb) {
+      return NULL;
+    }
+  } else {
+    if (_static_mb && _static_mb->size - _static_mb->nbytes < size) {
+      lev_slab_decRef( _static_mb );
+      _static_mb = lev_slab_getBlock( size );
+    } else if (!_static_mb){
+      _static_mb = lev_slab_getBlock( size );
+    }
+
+    mb = _static_mb;
+    if (size != _static_mb->size) {
+      if (!_static_mb->refcount) { /* give it a little init! That-a-boy! */
+        lev_slab_incRef( _static_mb );
+      }
+    } else { /* we completely own this MemBlock, no need to give it to others */
+      _static_mb = NULL;
+    }
+  }
+
+  *slice = mb->bytes + mb->nbytes;
+  mb->nbytes += size;
+  return mb;
+}
+
+/* is moving ms into a right-sized block worth a copy? */
+static int _buffer_compactable(MemSlice *ms) {
+  return ms->until && !ms->pinned
+    && ms->mb != _static_mb /* still being filled; a copy would land on it again */
+    && ms->mb->sliced * BUFFER_COMPACT_RATIO <= ms->mb->size;
+}
+
+/* move ms into a right-sized block; the old one goes once nothing else holds it */
+static int _buffer_compact(MemSlice *ms) {
+  lev_slab_retention_t *retention = lev_slab_retention();
+  unsigned char *slice;
+  MemBlock *mb;
+
+  mb = _buffer_carve(ms->until, &slice);
+  if (!mb) {
+    return -1;
+  }
+  lev_slab_incRef(mb);
+  memcpy(slice, ms->slice, ms->until);
+
+  lev_slab_slice(mb, ms->until);
+  lev_slab_slice(ms->mb, -(long)ms->until);
+  lev_slab_decRef(ms->mb);
+  ms->mb = mb;
+  ms->slice = slice;
+
+  retention->compactions++;
+  retention->compacted_bytes += ms->until;
+  return 0;
+}
+
+/* turn the compaction policy's bookkeeping on or off */
+void lev_buffer_track(int on) {
+  tracking = on;
+  if (!on) {
+    free(tracked);
+    tracked = NULL;
+    tracked_cap = tracked_count = tracked_used = 0;
+  }
+}
+
+/* compact the tracked slices that lived through a whole period; returns how many moved */
+int lev_buffer_sweep() {
+  unsigned int epoch = tracked_epoch++;
+  int moved = 0;
+  size_t i;
+
+  for (i = 0; i < tracked_cap; i++) {
+    MemSlice *ms = tracked[i].ms;
+    if (!ms || ms == BUFFER_TOMBSTONE || tracked[i].epoch == epoch) {
+      continue;
+    }
+    if (_buffer_compactable(ms) && !_buffer_compact(ms)) {
+      tracked[i].ms = BUFFER_TOMBSTONE;
+      tracked_count--;
+      moved++;
+    }
+  }
+  if (tracked_used > tracked_count * 2 && tracked_used > 64) {
+    _buffer_track_rehash(tracked_cap); /* drop the tombstones */
+  }
+  return moved;
+}
+
+size_t lev_buffer_tracked() {
+  return tracked_count;
+}
+
 int lev_pushbuffer_from_mb(lua_State *L, MemBlock *mb, size_t until, unsigned char *slice) {
   MemSlice *ms;
 
   lev_slab_incRef( mb );
 
-  ms = (MemSlice *)create_obj_init_ref(L, sizeof *ms, "lev.buffer");
+  ms = lev_buffer_alloc(L);
   ms->mb = mb;
   ms->slice = (!slice ? mb->bytes : slice);
   ms->until = (!until ? (!mb->nbytes ? mb->size : mb->nbytes) : until);
+  _buffer_retain(ms);
 
   /*printf("lev_pushbuffer_from_mb: mb:%p;s:%p;u:%lu\n", ms->mb, ms->slice, ms->until);*/
 
@@ -171,29 +388,19 @@ uv_buf_t lev_buffer_to_uv(lua_State *L, int index) {
 }
 
 MemSlice * lev_buffer_new(lua_State *L, size_t size, const char *temp, size_t temp_size) {
-  MemBlock *mb = NULL;
+  unsigned char *slice;
+  MemBlock *mb;
 
-  if (_static_mb && _static_mb->size - _static_mb->nbytes < size) {
-    lev_slab_decRef( _static_mb );
-    _static_mb = lev_slab_getBlock( size );
-  } else if (!_static_mb){
-    _static_mb = lev_slab_getBlock( size );
-  }
-
-  mb = _static_mb;
-  if (size != _static_mb->size) {
-    if (!_static_mb->refcount) { /* give it a little init! That-a-boy! */
-      lev_slab_incRef( _static_mb );
-    }
-  } else { /* we completely own this MemBlock, no need to give it to others */
-    _static_mb = NULL;
+  mb = _buffer_carve(size, &slice);
+  if (!mb) {
+    luaL_error(L, "cannot allocate a buffer of %d bytes", (int)size);
   }
 
   lev_pushbuffer_from_mb(
      L
     ,mb
     ,size
-    ,mb->bytes + mb->nbytes
+    ,slice
   ); /* automatically incRef's mb */
 
   if (temp) {
@@ -201,16 +408,14 @@ MemSlice * lev_buffer_new(lua_State *L, size_t size, const char *temp, size_t te
       temp_size = size;
     }
     memcpy(
-      mb->bytes + mb->nbytes
+      slice
       ,temp
       ,(size > temp_size ? temp_size : size)
       );
   } else {
-    memset(mb->bytes + mb->nbytes, '\0', size);
+    memset(slice, '\0', size);
   }
 
-  mb->nbytes += size;
-
   /* return the userdata */
   return lua_touserdata(L, -1);
 }
@@ -230,12 +435,17 @@ size_t lev_memslice_empty_length(MemSlice *ms) {
 /* 
   size is the size of the memslice that we want,
   *not* the size some byterange that we are about to append
+
+  this knows nothing of retention; a lev.buffer grows through
+  _buffer_append_mem instead.
+
+  returns 0, or -1 with ms untouched when no block could be had.
 */
-void lev_memslice_resize(MemSlice *ms, size_t size) {
+int lev_memslice_resize(MemSlice *ms, size_t size) {
   MemBlock *mb_new;
 
   if (size <= lev_memslice_empty_length(ms)) {
-    return;
+    return 0;
   }
 
   /*printf("[%p] GOING FOR RESIZE!\n", ms);*/
@@ -251,8 +461,24 @@ void lev_memslice_resize(MemSlice *ms, size_t size) {
     }
   } 
 
+  if (needs_new_mb && (ms->mb->flags & MEMBLOCK_LARGE) && ms->mb->refcount == 1) {
+    /* we are the only user of this extent -- let the kernel move the pages */
+    size_t offset = ms->slice - ms->mb->bytes;
+    mb_new = lev_slab_growBlock(ms->mb, offset + size);
+    if (mb_new) {
+      ms->mb = mb_new;
+      ms->slice = mb_new->bytes + offset;
+      ms->until = size;
+      mb_new->nbytes = offset + size;
+      return 0;
+    }
+  }
+
   if (needs_new_mb) {
     mb_new = lev_slab_getBlock( size );
+    if (!mb_new) {
+      return -1;
+    }
     lev_slab_incRef( mb_new );
     memcpy(
        mb_new->bytes
@@ -266,17 +492,18 @@ void lev_memslice_resize(MemSlice *ms, size_t size) {
     ms->mb->nbytes += size;
   } else {
     /* cool, we can use the remaining length of our current MemBlock */
-    ms->mb->nbytes += size;
+    ms->mb->nbytes += size - ms->until;
     ms->until = size;
   }
 
-  return;
+  return 0;
 }
 
-void lev_memslice_ensure_empty_length(MemSlice *ms, int len) {
+int lev_memslice_ensure_empty_length(MemSlice *ms, int len) {
   if (len > lev_memslice_empty_length(ms)) {
-    lev_memslice_resize(ms, len);
+    return lev_memslice_resize(ms, len);
   }
+  return 0;
 }
 
 void lev_memslice_append_char_unsafe(MemSlice *ms, size_t at, const char c) {
@@ -287,14 +514,20 @@ void lev_memslice_ensure_null(MemSlice *ms, size_t at) {
   ms->slice[at] = 0;
 }
 
-void lev_memslice_append_char(MemSlice *ms, size_t at, const char c) {
-  lev_memslice_ensure_empty_length(ms, at + 1);
+int lev_memslice_append_char(MemSlice *ms, size_t at, const char c) {
+  if (lev_memslice_ensure_empty_length(ms, at + 1)) {
+    return -1;
+  }
   ms->slice[at] = c;
+  return 0;
 }
 
-void lev_memslice_append_mem(MemSlice *ms, size_t from, const char *c, size_t len) {
-  lev_memslice_ensure_empty_length(ms, from + len);
+int lev_memslice_append_mem(MemSlice *ms, size_t from, const char *c, size_t len) {
+  if (lev_memslice_ensure_empty_length(ms, from + len)) {
+    return -1;
+  }
   memcpy(ms->slice + from, c, len);
+  return 0;
 }
 
 char *lev_memslice_empty_ptr(MemSlice *ms, size_t from) {
@@ -317,7 +550,9 @@ size_t lev_memslice_append_string(MemSlice *ms, size_t from, const char *str) {
 
   for (i = 0; str[i]; i++) {
     if (space < 1) {
-      lev_memslice_resize(ms, i + 1);
+      if (lev_memslice_resize(ms, i + 1)) {
+        break; /* the caller sees a short count */
+      }
       space = lev_memslice_empty_length(ms);
     }
     ms->slice[_from++] = str[i];
@@ -376,6 +611,340 @@ static int buffer_isbuffer (lua_State *L) {
   return 1;
 }
 
+/*
+  needle(str) / needle({ str, ... }) -> compiled needle for find/upUntil.
+  with several alternatives find() returns the earliest match of any of
+  them, plus the (1 based) index of the alternative that matched.
+*/
+static int buffer_needle (lua_State *L) {
+  lev_needle_t *needle;
+  const char *str;
+  size_t len, total = 0;
+  int index = 1;
+  int count, i;
+
+  if (lua_gettop(L) > 1 && LUA_TTABLE == lua_type(L, 1)) { /* Buffer:needle() */
+    index++;
+  }
+
+  if (LUA_TTABLE == lua_type(L, index)) {
+    count = lua_objlen(L, index);
+    if (count < 1 || count > LEV_SEARCH_MAX_NEEDLES) {
+      return luaL_argerror(L, index, "1 to 8 alternatives are supported");
+    }
+    for (i = 1; i <= count; i++) {
+      lua_rawgeti(L, index, i);
+      if (!lua_tolstring(L, -1, &len) || !len) {
+        return luaL_argerror(L, index, "alternatives must be non-empty strings");
+      }
+      total += len;
+      lua_pop(L, 1);
+    }
+  } else {
+    luaL_checklstring(L, index, &total);
+    if (!total) {
+      return luaL_argerror(L, index, "needle must not be empty");
+    }
+    count = 0;
+  }
+
+  needle = (lev_needle_t *)lua_newuserdata(L, lev_needle_sizeof(total));
+  lev_needle_init(needle);
+  luaL_getmetatable(L, "lev.needle");
+  lua_setmetatable(L, -2);
+
+  if (!count) {
+    str = lua_tolstring(L, index, &len);
+    lev_needle_add(needle, (const unsigned char *)str, len);
+  }
+  for (i = 1; i <= count; i++) {
+    lua_rawgeti(L, index, i);
+    str = lua_tolstring(L, -1, &len);
+    lev_needle_add(needle, (const unsigned char *)str, len);
+    lua_pop(L, 1);
+  }
+
+  return 1;
+}
+
+/* searchKernel([name]) -> "generic" | "sse2" | "avx2" */
+static int buffer_searchkernel (lua_State *L) {
+  const char *name = luaL_optstring(L, 1, NULL);
+
+  if (name && lev_search_set_kernel(name)) {
+    return luaL_argerror(L, 1, "unknown or unsupported search kernel");
+  }
+  lua_pushstring(L, lev_search_kernel_name());
+  return 1;
+}
+
+/*
+  format(fmt) -> compiled pack/unpack plan, see lev_pack.h for the syntax.
+  passing a plan instead of the format string skips parsing it on every call.
+*/
+static int buffer_format (lua_State *L) {
+  lev_pack_plan_t plan, *compiled;
+  const char *fmt, *err;
+  size_t fmt_len, size;
+  int index = 1;
+
+  if (lua_gettop(L) > 1 && LUA_TTABLE == lua_type(L, 1)) { /* Buffer:format() */
+    index++;
+  }
+  fmt = luaL_checklstring(L, index, &fmt_len);
+  if (lev_pack_compile(&plan, fmt, fmt_len, &err)) {
+    return luaL_argerror(L, index, err);
+  }
+
+  size = offsetof(lev_pack_plan_t, ops) + plan.count * sizeof(lev_pack_op_t);
+  compiled = (lev_pack_plan_t *)lua_newuserdata(L, size);
+  memcpy(compiled, &plan, size);
+  luaL_getmetatable(L, "lev.format");
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+/* size(format) -> bytes taken, or nil when that depends on the values */
+static int format_size (lua_State *L) {
+  lev_pack_plan_t *plan = BUFFER_FORMAT_UDATA(L, 1);
+
+  if (plan->variable) {
+    lua_pushnil(L);
+  } else {
+    lua_pushinteger(L, plan->fixed);
+  }
+  return 1;
+}
+
+/* codecKernel([name]) -> "generic" | "sse2" | "ssse3" */
+static int buffer_codeckernel (lua_State *L) {
+  const char *name = luaL_optstring(L, 1, NULL);
+
+  if (name && lev_codec_set_kernel(name)) {
+    return luaL_argerror(L, 1, "unknown or unsupported codec kernel");
+  }
+  lua_pushstring(L, lev_codec_kernel_name());
+  return 1;
+}
+
+/* the bytes of the lev.buffer or string at index */
+static const unsigned char *buffer_tobytes(lua_State *L, int index, size_t *len) {
+  MemSlice *ms;
+
+  if (LUA_TUSERDATA == lua_type(L, index)) {
+    ms = luaL_checkudata(L, index, "lev.buffer");
+    *len = ms->until;
+    return ms->slice;
+  }
+  return (const unsigned char *)luaL_checklstring(L, index, len);
+}
+
+/* a new slab backed buffer of exactly size bytes, even when size is 0 */
+static MemSlice *buffer_push_sized(lua_State *L, size_t size) {
+  MemSlice *ms = lev_buffer_new(L, size, NULL, 0);
+
+  lev_buffer_set_length(ms, size);
+  return ms;
+}
+
+/* fromHex(str | buffer) -> buffer, or nil if it is not hex */
+static int buffer_fromhex (lua_State *L) {
+  const unsigned char *src;
+  size_t len, size;
+  MemSlice *ms;
+  int index = 1;
+
+  if (lua_gettop(L) > 1 && LUA_TTABLE == lua_type(L, 1)) { /* Buffer:fromHex() */
+    index++;
+  }
+  src = buffer_tobytes(L, index, &len);
+  size = lev_hex_decoded_len(len);
+  if (size == (size_t)-1) {
+    lua_pushnil(L);
+    return 1;
+  }
+  ms = buffer_push_sized(L, size);
+  if (lev_hex_decode(ms->slice, src, len)) {
+    lua_pushnil(L);
+  }
+  return 1;
+}
+
+/* fromBase64(str | buffer, url) -> buffer, or nil if it is not base64 */
+static int buffer_frombase64 (lua_State *L) {
+  const unsigned char *src;
+  size_t len, size;
+  MemSlice *ms;
+  int index = 1;
+
+  if (lua_gettop(L) > 1 && LUA_TTABLE == lua_type(L, 1)) { /* Buffer:fromBase64() */
+    index++;
+  }
+  src = buffer_tobytes(L, index, &len);
+  size = lev_base64_decoded_len(src, len);
+  if (size == (size_t)-1) {
+    lua_pushnil(L);
+    return 1;
+  }
+  ms = buffer_push_sized(L, size);
+  if (lev_base64_decode(ms->slice, src, len, lua_toboolean(L, index + 1) ? LEV_BASE64_URL : 0)) {
+    lua_pushnil(L);
+  }
+  return 1;
+}
+
+/******************************************************************************/
+
+#define BUFFER_HASH_CRC32   0
+#define BUFFER_HASH_CRC32C  1
+#define BUFFER_HASH_ADLER32 2
+#define BUFFER_HASH_XXH64   3
+
+static const char *hash_names[] = { "crc32", "crc32c", "adler32", "xxh64", NULL };
+
+typedef uint32_t (*buffer_checksum_fn)(uint32_t, const unsigned char *, size_t);
+
+static const buffer_checksum_fn hash_checksums[] = { lev_crc32, lev_crc32c, lev_adler32 };
+
+/* a running checksum or hash; see Buffer.hasher() */
+typedef struct _buffer_hasher {
+  int algo;       /* BUFFER_HASH_* */
+  uint32_t value; /* the 32 bit checksums */
+  lev_xxh64_t xxh;
+} buffer_hasher_t;
+
+/*
+  the bytes of the buffer or string at data, from the offset at arg (1
+  based) over the length at arg + 1; both default to the whole thing.
+*/
+static const unsigned char *buffer_range(lua_State *L, int data, int arg, size_t *len) {
+  size_t total;
+  const unsigned char *src = buffer_tobytes(L, data, &total);
+  size_t offset = (size_t)luaL_optinteger(L, arg, 1);
+  size_t length;
+
+  if (offset < 1 || offset - 1 > total) {
+    luaL_argerror(L, arg, "Offset out of bounds");
+  }
+  offset--; /* account for Lua-isms */
+
+  length = (size_t)luaL_optinteger(L, arg + 1, total - offset);
+  if (length > total - offset) {
+    luaL_argerror(L, arg + 1, "length out of bounds");
+  }
+  *len = length;
+  return src + offset;
+}
+
+/* 64 bit results do not fit a Lua number; they go out as 16 hex digits */
+static void buffer_push_hash64(lua_State *L, uint64_t h) {
+  unsigned char bytes[8];
+  unsigned char hex[16];
+  int i;
+
+  for (i = 7; i >= 0; i--, h >>= 8) {
+    bytes[i] = (unsigned char)h;
+  }
+  lev_hex_encode(hex, bytes, 8, 0);
+  lua_pushlstring(L, (const char *)hex, 16);
+}
+
+static int buffer_checksum (lua_State *L, int algo) {
+  uint32_t value = (uint32_t)luaL_optnumber(L, 2, algo == BUFFER_HASH_ADLER32 ? 1 : 0);
+  size_t len;
+  const unsigned char *src = buffer_range(L, 1, 3, &len);
+
+  lua_pushnumber(L, hash_checksums[algo](value, src, len));
+  return 1;
+}
+
+/* crc32(buffer, crc, offset, length) -> crc; pass the last crc to continue */
+static int buffer_crc32 (lua_State *L) {
+  return buffer_checksum(L, BUFFER_HASH_CRC32);
+}
+
+/* crc32c(buffer, crc, offset, length) -> crc */
+static int buffer_crc32c (lua_State *L) {
+  return buffer_checksum(L, BUFFER_HASH_CRC32C);
+}
+
+/* adler32(buffer, adler, offset, length) -> adler */
+static int buffer_adler32 (lua_State *L) {
+  return buffer_checksum(L, BUFFER_HASH_ADLER32);
+}
+
+/* xxh64(buffer, seed, offset, length) -> 16 hex digits */
+static int buffer_xxh64 (lua_State *L) {
+  uint64_t seed = (uint64_t)(int64_t)luaL_optnumber(L, 2, 0);
+  size_t len;
+  const unsigned char *src = buffer_range(L, 1, 3, &len);
+
+  buffer_push_hash64(L, lev_xxh64(src, len, seed));
+  return 1;
+}
+
+/* hasher(name, seed) -> hasher; name is "crc32", "crc32c", "adler32" or "xxh64" */
+static int buffer_hasher (lua_State *L) {
+  buffer_hasher_t *hasher;
+  int index = 1;
+  int algo;
+
+  if (LUA_TTABLE == lua_type(L, 1)) { /* Buffer:hasher() */
+    index++;
+  }
+  algo = luaL_checkoption(L, index, NULL, hash_names);
+
+  hasher = (buffer_hasher_t *)lua_newuserdata(L, sizeof *hasher);
+  luaL_getmetatable(L, "lev.hasher");
+  lua_setmetatable(L, -2);
+
+  hasher->algo = algo;
+  if (algo == BUFFER_HASH_XXH64) {
+    lev_xxh64_init(&hasher->xxh, (uint64_t)(int64_t)luaL_optnumber(L, index + 1, 0));
+  } else {
+    hasher->value = (uint32_t)luaL_optnumber(L, index + 1, algo == BUFFER_HASH_ADLER32 ? 1 : 0);
+  }
+  return 1;
+}
+
+/* update(hasher, buffer | str, offset, length) -> hasher */
+static int hasher_update (lua_State *L) {
+  buffer_hasher_t *hasher = BUFFER_HASHER_UDATA(L, 1);
+  size_t len;
+  const unsigned char *src = buffer_range(L, 2, 3, &len);
+
+  if (hasher->algo == BUFFER_HASH_XXH64) {
+    lev_xxh64_update(&hasher->xxh, src, len);
+  } else {
+    hasher->value = hash_checksums[hasher->algo](hasher->value, src, len);
+  }
+  lua_settop(L, 1);
+  return 1;
+}
+
+/* digest(hasher) -> number, or 16 hex digits for xxh64; the hasher can go on */
+static int hasher_digest (lua_State *L) {
+  buffer_hasher_t *hasher = BUFFER_HASHER_UDATA(L, 1);
+
+  if (hasher->algo == BUFFER_HASH_XXH64) {
+    buffer_push_hash64(L, lev_xxh64_digest(&hasher->xxh));
+  } else {
+    lua_pushnumber(L, hasher->value);
+  }
+  return 1;
+}
+
+/* hashKernel([name]) -> "generic" | "sse4.2"; the crc32c implementation */
+static int buffer_hashkernel (lua_State *L) {
+  const char *name = luaL_optstring(L, 1, NULL);
+
+  if (name && lev_hash_set_kernel(name)) {
+    return luaL_argerror(L, 1, "unknown or unsupported hash kernel");
+  }
+  lua_pushstring(L, lev_hash_kernel_name());
+  return 1;
+}
+
 /******************************************************************************/
 
 /* tostring(buffer, i, j) */
@@ -430,14 +999,75 @@ static int buffer_slice (lua_State *L) {
   }
 
   lev_slab_incRef( ms->mb );
-  slice_ms = (MemSlice *)create_obj_init_ref(L, sizeof *slice_ms, "lev.buffer");
+  slice_ms = lev_buffer_alloc(L);
   slice_ms->mb = ms->mb;
   slice_ms->slice = ms->slice + offset;
   slice_ms->until = length;
+  _buffer_retain(slice_ms);
 
   return 1;
 }
 
+/* detach(buffer) -> a copy of buffer that keeps only its own bytes alive */
+static int buffer_detach (lua_State *L) {
+  BUFFER_UDATA(L)
+
+  lev_buffer_set_length(lev_buffer_new(L, buffer_len, (const char *)buffer, buffer_len), buffer_len);
+  return 1;
+}
+
+/*
+  compact(buffer, force) -> moved
+  copy the buffer's bytes somewhere right-sized (small ones are packed
+  with other new buffers) when the block it sits on is mostly invisible
+  through live buffers, or always with force. the buffer object stays
+  the same, so every reference to it sees the move.
+*/
+static int buffer_compact (lua_State *L) {
+  MemSlice *ms = luaL_checkudata(L, 1, "lev.buffer");
+  int force = lua_toboolean(L, 2);
+
+  if (ms->pinned) {
+    return luaL_error(L, "cannot compact a buffer pinned by ptr()");
+  }
+  if (!(force ? ms->until && ms->mb != _static_mb : _buffer_compactable(ms))) {
+    lua_pushboolean(L, 0);
+    return 1;
+  }
+  if (_buffer_compact(ms)) {
+    return luaL_error(L, "cannot allocate a buffer of %d bytes", (int)ms->until);
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+/* retention(buffer) -> size of the block buffer keeps alive, bytes of it visible through buffers */
+static int buffer_retention (lua_State *L) {
+  MemSlice *ms = luaL_checkudata(L, 1, "lev.buffer");
+
+  lua_pushnumber(L, ms->mb->size);
+  lua_pushnumber(L, ms->mb->sliced);
+  return 2;
+}
+
+/*
+  ptr(buffer) -> lightuserdata, length
+  the raw bytes, for ffi.cast("uint8_t *", ...). they stay where they are
+  for as long as the buffer is alive: the buffer is dropped from automatic
+  compaction, and from then on growing or compact()ing it is an error.
+*/
+static int buffer_ptr (lua_State *L) {
+  MemSlice *ms = luaL_checkudata(L, 1, "lev.buffer");
+
+  if (tracked_count) {
+    _buffer_track_remove(ms);
+  }
+  ms->pinned = 1;
+  lua_pushlightuserdata(L, ms->slice);
+  lua_pushnumber(L, ms->until);
+  return 2;
+}
+
 /* fill(buffer, char, i, j) */
 static int buffer_fill (lua_State *L) {
   BUFFER_UDATA(L)
@@ -480,38 +1110,187 @@ static int buffer_fill (lua_State *L) {
   return 0;
 }
 
-/* find(buffer, char) */
+/* a compiled lev.needle at index, or NULL with the string in *str */
+static const lev_needle_t *buffer_toneedle(lua_State *L, int index, const unsigned char **str, size_t *str_len) {
+  if (LUA_TUSERDATA == lua_type(L, index)) {
+    *str = NULL;
+    *str_len = 0;
+    return BUFFER_NEEDLE_UDATA(L, index);
+  }
+  *str = (const unsigned char *)lua_tolstring(L, index, str_len);
+  return NULL;
+}
+
+static const unsigned char *buffer_search(const lev_needle_t *needle, const unsigned char *str, size_t str_len,
+                                          const unsigned char *hay, size_t hay_len, int *which) {
+  if (needle) {
+    return lev_needle_find(needle, hay, hay_len, which);
+  }
+  *which = 0;
+  return lev_search(hay, hay_len, str, str_len);
+}
+
+/* find(buffer, needle, init) -> position [, alternative] */
 static int buffer_find (lua_State *L) {
-  size_t delimiter_len;
-  const char *delimiter_buf = NULL;
-  const char *found = NULL;
+  const lev_needle_t *needle;
+  const unsigned char *str;
+  size_t str_len;
+  const unsigned char *found;
+  int which;
 
   BUFFER_UDATA(L)
 
-  delimiter_buf = lua_tolstring(L, 2, &delimiter_len);
-  if (!delimiter_buf) {
+  needle = buffer_toneedle(L, 2, &str, &str_len);
+  if (!needle && !str) {
     return luaL_argerror(L, 2, "String is Required");
   }
+  if (!needle && !str_len) {
+    lua_pushnil(L);
+    return 1;
+  }
 
-  if (!delimiter_len) {
+  size_t offset = (size_t)lua_tointeger(L, 3);
+  if (!offset) {
+    offset = 1;
+  }
+  if (offset > buffer_len) {
     lua_pushnil(L);
     return 1;
   }
+  offset--; /* account for Lua-isms */
 
-  /* use memmem to find first instance of our delimiter */
-  found = memmem(
-             (const char *)buffer
-            ,buffer_len
-            ,delimiter_buf
-            ,delimiter_len
-          );
+  found = buffer_search(needle, str, str_len, buffer + offset, buffer_len - offset, &which);
 
   if (!found) {
     lua_pushnil(L);
-  } else {
-    lua_pushnumber(L, (size_t)(found - (const char *)buffer) + 1);
+    return 1;
   }
+  lua_pushnumber(L, (size_t)(found - buffer) + 1);
+  if (needle && needle->count > 1) {
+    lua_pushinteger(L, which + 1);
+    return 2;
+  }
+  return 1;
+}
 
+/*
+  lastIndexOf(buffer, str | buffer, from) -> index or nil
+  the last match starting at or before from (default: anywhere)
+*/
+static int buffer_lastindexof (lua_State *L) {
+  const unsigned char *needle, *found;
+  size_t needle_len, hay_len;
+
+  BUFFER_UDATA(L)
+
+  needle = buffer_tobytes(L, 2, &needle_len);
+  size_t from = (size_t)luaL_optinteger(L, 3, buffer_len);
+  if (from < 1 || !needle_len) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  hay_len = from - 1 + needle_len;
+  if (hay_len > buffer_len) {
+    hay_len = buffer_len;
+  }
+  found = lev_search_last(buffer, hay_len, needle, needle_len);
+  if (!found) {
+    lua_pushnil(L);
+    return 1;
+  }
+  lua_pushnumber(L, (size_t)(found - buffer) + 1);
+  return 1;
+}
+
+/*
+  copy(buffer, target, tStart, sStart, sEnd) -> bytes copied
+  bytes sStart..sEnd of buffer go to target from tStart on, cut short at
+  the end of target. target may be buffer itself; overlaps are fine.
+*/
+static int buffer_copy (lua_State *L) {
+  BUFFER_UDATA(L)
+
+  MemSlice *target = luaL_checkudata(L, 2, "lev.buffer");
+  size_t target_start = (size_t)luaL_optinteger(L, 3, 1);
+  size_t start = (size_t)luaL_optinteger(L, 4, 1);
+  size_t end = (size_t)luaL_optinteger(L, 5, buffer_len);
+  size_t length;
+
+  if (target_start < 1 || target_start - 1 > target->until) {
+    return luaL_argerror(L, 3, "Offset out of bounds");
+  }
+  if (start < 1 || start - 1 > buffer_len) {
+    return luaL_argerror(L, 4, "Offset out of bounds");
+  }
+  if (end < start - 1 || end > buffer_len) {
+    return luaL_argerror(L, 5, "end out of bounds");
+  }
+
+  target_start--; /* account for Lua-isms */
+  start--;
+
+  length = end - start;
+  if (length > target->until - target_start) {
+    length = target->until - target_start;
+  }
+  memmove(target->slice + target_start, buffer + start, length);
+
+  lua_pushnumber(L, length);
+  return 1;
+}
+
+/* compare(buffer, str | buffer) -> -1, 0 or 1; bytewise, a prefix sorts first */
+static int buffer_compare (lua_State *L) {
+  const unsigned char *other;
+  size_t other_len;
+  int r;
+
+  BUFFER_UDATA(L)
+
+  other = buffer_tobytes(L, 2, &other_len);
+  r = memcmp(buffer, other, buffer_len < other_len ? buffer_len : other_len);
+  if (!r) {
+    r = (buffer_len > other_len) - (buffer_len < other_len);
+  }
+  lua_pushinteger(L, r < 0 ? -1 : r > 0);
+  return 1;
+}
+
+/* equals(buffer, str | buffer) -> boolean */
+static int buffer_equals (lua_State *L) {
+  const unsigned char *other;
+  size_t other_len;
+
+  BUFFER_UDATA(L)
+
+  other = buffer_tobytes(L, 2, &other_len);
+  lua_pushboolean(L, buffer_len == other_len && !memcmp(buffer, other, buffer_len));
+  return 1;
+}
+
+/* startsWith(buffer, str | buffer) -> boolean */
+static int buffer_startswith (lua_State *L) {
+  const unsigned char *prefix;
+  size_t prefix_len;
+
+  BUFFER_UDATA(L)
+
+  prefix = buffer_tobytes(L, 2, &prefix_len);
+  lua_pushboolean(L, prefix_len <= buffer_len && !memcmp(buffer, prefix, prefix_len));
+  return 1;
+}
+
+/* endsWith(buffer, str | buffer) -> boolean */
+static int buffer_endswith (lua_State *L) {
+  const unsigned char *suffix;
+  size_t suffix_len;
+
+  BUFFER_UDATA(L)
+
+  suffix = buffer_tobytes(L, 2, &suffix_len);
+  lua_pushboolean(L, suffix_len <= buffer_len
+                  && !memcmp(buffer + buffer_len - suffix_len, suffix, suffix_len));
   return 1;
 }
 
@@ -548,18 +1327,19 @@ static int buffer_inspect (lua_State *L) {
 
 /* upuntil(buffer, i, j) */
 static int buffer_upuntil (lua_State *L) {
-  size_t delimiter_len;
-  const char *delimiter_buf = NULL;
-  const char *found = NULL;
+  const lev_needle_t *needle;
+  const unsigned char *str;
+  size_t str_len;
+  const unsigned char *found;
+  int which;
 
   BUFFER_UDATA(L)
 
-  delimiter_buf = lua_tolstring(L, 2, &delimiter_len);
-  if (!delimiter_buf) {
+  needle = buffer_toneedle(L, 2, &str, &str_len);
+  if (!needle && !str) {
     return luaL_argerror(L, 2, "Delimiter String is Required");
   }
-
-  if (!delimiter_len) {
+  if (!needle && !str_len) {
     lua_pushlstring(L, "", 0);
     return 1;
   }
@@ -573,20 +1353,14 @@ static int buffer_upuntil (lua_State *L) {
   }
   offset--; /* account for Lua-isms */
 
-  /* use memmem to find first instance of our delimiter */
-  found = memmem(
-             (const char *)buffer + offset
-            ,buffer_len - offset
-            ,delimiter_buf
-            ,delimiter_len
-          );
+  found = buffer_search(needle, str, str_len, buffer + offset, buffer_len - offset, &which);
 
   if (!found) { /* if nothing is found, return from offset */
     lua_pushlstring(L, (const char *)buffer + offset, buffer_len - offset);
   } else {
     lua_pushlstring(L, 
        (const char *)buffer + offset
-      ,found - ((const char *)buffer) - offset
+      ,found - buffer - offset
     );
   }
   return 1;
@@ -748,6 +1522,320 @@ static int buffer_writeInt32LE (lua_State *L) {
   return 0;
 }
 
+/* a compiled lev.format at index, or the format string there compiled into scratch */
+static const lev_pack_plan_t *buffer_toplan(lua_State *L, int index, lev_pack_plan_t *scratch) {
+  const char *fmt, *err;
+  size_t fmt_len;
+
+  if (LUA_TUSERDATA == lua_type(L, index)) {
+    return BUFFER_FORMAT_UDATA(L, index);
+  }
+  fmt = luaL_checklstring(L, index, &fmt_len);
+  if (lev_pack_compile(scratch, fmt, fmt_len, &err)) {
+    luaL_argerror(L, index, err);
+  }
+  return scratch;
+}
+
+/* the bits stored for an integer field; negative values wrap like a C cast */
+static uint64_t buffer_tobits(lua_Number n) {
+  if (n >= 18446744073709551615.0) {
+    return ~(uint64_t)0;
+  }
+  if (n < 0) {
+    return n <= -9223372036854775808.0 ? (uint64_t)1 << 63 : (uint64_t)(int64_t)n;
+  }
+  return (uint64_t)n;
+}
+
+static uint64_t buffer_tovarint(const lev_pack_op_t *op, lua_Number n) {
+  int64_t v;
+
+  if (!op->sign) {
+    return buffer_tobits(n);
+  }
+  v = (int64_t)buffer_tobits(n);
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); /* zigzag */
+}
+
+/* pack(buffer, format, offset, ...) -> offset just past the bytes written */
+static int buffer_pack (lua_State *L) {
+  lev_pack_plan_t scratch;
+  const lev_pack_plan_t *plan;
+  const lev_pack_op_t *op;
+  const char *str;
+  unsigned char *p;
+  size_t len, need;
+  lua_Number n;
+  int i, arg;
+
+  BUFFER_UDATA(L)
+
+  plan = buffer_toplan(L, 2, &scratch);
+  size_t offset = (size_t)luaL_optinteger(L, 3, 1);
+  if (offset < 1 || offset - 1 > buffer_len) {
+    return luaL_argerror(L, 3, "Index out of bounds");
+  }
+  if (lua_gettop(L) - 3 < plan->values) {
+    return luaL_error(L, "format takes %d values, got %d", plan->values, lua_gettop(L) - 3);
+  }
+
+  /* check every value and size the result first, so errors leave the buffer untouched */
+  need = plan->fixed;
+  for (i = 0, arg = 4; i < plan->count; i++) {
+    op = &plan->ops[i];
+    switch (op->code) {
+      case LEV_PACK_PAD:
+        continue;
+      case LEV_PACK_INT:
+      case LEV_PACK_FLOAT:
+        luaL_checknumber(L, arg);
+        break;
+      case LEV_PACK_VARINT:
+        n = luaL_checknumber(L, arg);
+        if (n < 0 && !op->sign) {
+          return luaL_argerror(L, arg, "unsigned varint must not be negative");
+        }
+        need += lev_pack_varint_size(buffer_tovarint(op, n));
+        break;
+      case LEV_PACK_FIXED:
+        luaL_checklstring(L, arg, &len);
+        if (len > op->len) {
+          return luaL_argerror(L, arg, "string longer than given size");
+        }
+        break;
+      case LEV_PACK_STRING:
+        luaL_checklstring(L, arg, &len);
+        if (op->size < 8 && (uint64_t)len >> (op->size * 8)) {
+          return luaL_argerror(L, arg, "string length does not fit the given size");
+        }
+        need += len;
+        break;
+      case LEV_PACK_CSTRING:
+        str = luaL_checklstring(L, arg, &len);
+        if (memchr(str, 0, len)) {
+          return luaL_argerror(L, arg, "string contains zeros");
+        }
+        need += len + 1;
+        break;
+    }
+    arg++;
+  }
+  if (need > buffer_len - (offset - 1)) {
+    return luaL_argerror(L, 3, "values do not fit in the buffer");
+  }
+
+  p = buffer + offset - 1;
+  for (i = 0, arg = 4; i < plan->count; i++) {
+    op = &plan->ops[i];
+    switch (op->code) {
+      case LEV_PACK_PAD:
+        *p++ = 0;
+        continue;
+      case LEV_PACK_INT:
+        lev_pack_put(p, op, buffer_tobits(lua_tonumber(L, arg)));
+        p += op->size;
+        break;
+      case LEV_PACK_FLOAT:
+        lev_pack_put_float(p, op, lua_tonumber(L, arg));
+        p += op->size;
+        break;
+      case LEV_PACK_VARINT:
+        p += lev_pack_put_varint(p, buffer_tovarint(op, lua_tonumber(L, arg)));
+        break;
+      case LEV_PACK_FIXED:
+        str = lua_tolstring(L, arg, &len);
+        memcpy(p, str, len);
+        memset(p + len, 0, op->len - len);
+        p += op->len;
+        break;
+      case LEV_PACK_STRING:
+        str = lua_tolstring(L, arg, &len);
+        lev_pack_put(p, op, len);
+        p += op->size;
+        memcpy(p, str, len);
+        p += len;
+        break;
+      case LEV_PACK_CSTRING:
+        str = lua_tolstring(L, arg, &len);
+        memcpy(p, str, len);
+        p[len] = 0;
+        p += len + 1;
+        break;
+    }
+    arg++;
+  }
+
+  lua_pushinteger(L, (p - buffer) + 1);
+  return 1;
+}
+
+/*
+  unpack(buffer, format, offset) -> values..., offset just past the bytes read
+  returns nil alone when the buffer ends before the format does, so a
+  stream parser can wait for more data.
+*/
+static int buffer_unpack (lua_State *L) {
+  lev_pack_plan_t scratch;
+  const lev_pack_plan_t *plan;
+  const lev_pack_op_t *op;
+  const unsigned char *p, *end, *zero;
+  uint64_t bits;
+  size_t len;
+  int i;
+
+  BUFFER_UDATA(L)
+
+  plan = buffer_toplan(L, 2, &scratch);
+  size_t offset = (size_t)luaL_optinteger(L, 3, 1);
+  if (offset < 1 || offset - 1 > buffer_len) {
+    return luaL_argerror(L, 3, "Index out of bounds");
+  }
+  luaL_checkstack(L, plan->values + 1, "too many values to unpack");
+
+  p = buffer + offset - 1;
+  end = buffer + buffer_len;
+  if (plan->fixed > (size_t)(end - p)) {
+    goto truncated;
+  }
+
+  for (i = 0; i < plan->count; i++) {
+    op = &plan->ops[i];
+    /* fixed width fields were covered by the check above unless a
+       variable one came first */
+    if (plan->variable && op->size > (size_t)(end - p)) {
+      goto truncated;
+    }
+    switch (op->code) {
+      case LEV_PACK_PAD:
+        p++;
+        break;
+      case LEV_PACK_INT:
+        bits = lev_pack_get(p, op);
+        lua_pushnumber(L, op->sign ? (lua_Number)(int64_t)bits : (lua_Number)bits);
+        p += op->size;
+        break;
+      case LEV_PACK_FLOAT:
+        lua_pushnumber(L, lev_pack_get_float(p, op));
+        p += op->size;
+        break;
+      case LEV_PACK_VARINT:
+        len = lev_pack_get_varint(p, end - p, &bits);
+        if (!len) {
+          if (end - p < LEV_PACK_MAX_VARINT) {
+            goto truncated;
+          }
+          return luaL_error(L, "malformed varint at offset %d", (int)(p - buffer) + 1);
+        }
+        if (op->sign) {
+          lua_pushnumber(L, (lua_Number)((int64_t)(bits >> 1) ^ -(int64_t)(bits & 1)));
+        } else {
+          lua_pushnumber(L, (lua_Number)bits);
+        }
+        p += len;
+        break;
+      case LEV_PACK_FIXED:
+        if (op->len > (size_t)(end - p)) {
+          goto truncated;
+        }
+        lua_pushlstring(L, (const char *)p, op->len);
+        p += op->len;
+        break;
+      case LEV_PACK_STRING:
+        bits = lev_pack_get(p, op);
+        p += op->size;
+        if (bits > (uint64_t)(end - p)) {
+          goto truncated;
+        }
+        lua_pushlstring(L, (const char *)p, (size_t)bits);
+        p += bits;
+        break;
+      case LEV_PACK_CSTRING:
+        zero = memchr(p, 0, end - p);
+        if (!zero) {
+          goto truncated;
+        }
+        lua_pushlstring(L, (const char *)p, zero - p);
+        p = zero + 1;
+        break;
+    }
+  }
+
+  lua_pushinteger(L, (p - buffer) + 1);
+  return plan->values + 1;
+
+truncated:
+  lua_settop(L, 0);
+  lua_pushnil(L);
+  return 1;
+}
+
+/* toHex(buffer, upper) -> new buffer with the hex digits */
+static int buffer_tohex (lua_State *L) {
+  MemSlice *out;
+
+  BUFFER_UDATA(L)
+
+  out = buffer_push_sized(L, lev_hex_encoded_len(buffer_len));
+  lev_hex_encode(out->slice, buffer, buffer_len, lua_toboolean(L, 2));
+  return 1;
+}
+
+/* toBase64(buffer, url) -> new buffer with the base64 text */
+static int buffer_tobase64 (lua_State *L) {
+  int flags = lua_toboolean(L, 2) ? LEV_BASE64_URL : 0;
+  MemSlice *out;
+
+  BUFFER_UDATA(L)
+
+  out = buffer_push_sized(L, lev_base64_encoded_len(buffer_len, flags));
+  lev_base64_encode(out->slice, buffer, buffer_len, flags);
+  return 1;
+}
+
+/* writeHex(buffer, str | buffer, offset, upper) -> offset just past the digits written */
+static int buffer_writehex (lua_State *L) {
+  const unsigned char *src;
+  size_t len;
+
+  BUFFER_UDATA(L)
+
+  src = buffer_tobytes(L, 2, &len);
+  size_t offset = (size_t)luaL_optinteger(L, 3, 1);
+  if (offset < 1 || offset - 1 > buffer_len) {
+    return luaL_argerror(L, 3, "Index out of bounds");
+  }
+  if (lev_hex_encoded_len(len) > buffer_len - (offset - 1)) {
+    return luaL_argerror(L, 2, "encoded data does not fit in the buffer");
+  }
+
+  offset += lev_hex_encode(buffer + offset - 1, src, len, lua_toboolean(L, 4));
+  lua_pushinteger(L, offset);
+  return 1;
+}
+
+/* writeBase64(buffer, str | buffer, offset, url) -> offset just past the text written */
+static int buffer_writebase64 (lua_State *L) {
+  int flags = lua_toboolean(L, 4) ? LEV_BASE64_URL : 0;
+  const unsigned char *src;
+  size_t len;
+
+  BUFFER_UDATA(L)
+
+  src = buffer_tobytes(L, 2, &len);
+  size_t offset = (size_t)luaL_optinteger(L, 3, 1);
+  if (offset < 1 || offset - 1 > buffer_len) {
+    return luaL_argerror(L, 3, "Index out of bounds");
+  }
+  if (lev_base64_encoded_len(len, flags) > buffer_len - (offset - 1)) {
+    return luaL_argerror(L, 2, "encoded data does not fit in the buffer");
+  }
+
+  offset += lev_base64_encode(buffer + offset - 1, src, len, flags);
+  lua_pushinteger(L, offset);
+  return 1;
+}
+
 /* writeHexLower(buffer, write, offset) */
 static int buffer_write_hex_lower (lua_State *L) {
   size_t write_int;
@@ -801,7 +1889,7 @@ static int buffer_write_hex_upper (lua_State *L) {
 /* __gc(buffer) */
 static int buffer__gc (lua_State *L) {
   MemSlice *ms = luaL_checkudata(L, 1, "lev.buffer");
-  lev_slab_decRef( ms->mb );
+  _buffer_release(ms);
   return 0;
 }
 
@@ -1009,8 +2097,9 @@ static int buffer__newindex (lua_State *L) {
   switch (entry_type) {
     case LUA_TUSERDATA:
       value_ms = luaL_checkudata(L, 3, "lev.buffer");
-      lev_memslice_append_mem(
-           ms
+      _buffer_append_mem(
+           L
+          ,ms
           ,index - 1 /* offset */
           ,(const char *)value_ms->slice
           ,value_ms->until
@@ -1018,8 +2107,9 @@ static int buffer__newindex (lua_State *L) {
       break;
     case LUA_TSTRING:
       value = lua_tolstring(L, 3, &value_len);
-      lev_memslice_append_mem(
-           ms
+      _buffer_append_mem(
+           L
+          ,ms
           ,index - 1 /* offset */
           ,(const char *)value
           ,value_len
@@ -1058,7 +2148,17 @@ static luaL_reg methods[] = {
   ,{"inspect", buffer_inspect}
   ,{"fill", buffer_fill}
   ,{"find", buffer_find}
+  ,{"lastIndexOf", buffer_lastindexof}
+  ,{"copy", buffer_copy}
+  ,{"compare", buffer_compare}
+  ,{"equals", buffer_equals}
+  ,{"startsWith", buffer_startswith}
+  ,{"endsWith", buffer_endswith}
   ,{"slice", buffer_slice}
+  ,{"detach", buffer_detach}
+  ,{"compact", buffer_compact}
+  ,{"retention", buffer_retention}
+  ,{"ptr", buffer_ptr}
 
   /* convenience */
   ,{"s", buffer_tostring}
@@ -1081,6 +2181,16 @@ static luaL_reg methods[] = {
   ,{"writeUInt32LE", buffer_writeUInt32LE}
   ,{"writeInt32BE", buffer_writeInt32BE}
   ,{"writeInt32LE", buffer_writeInt32LE}
+  ,{"pack", buffer_pack}
+  ,{"unpack", buffer_unpack}
+  ,{"toHex", buffer_tohex}
+  ,{"toBase64", buffer_tobase64}
+  ,{"crc32", buffer_crc32}
+  ,{"crc32c", buffer_crc32c}
+  ,{"adler32", buffer_adler32}
+  ,{"xxh64", buffer_xxh64}
+  ,{"writeHex", buffer_writehex}
+  ,{"writeBase64", buffer_writebase64}
 
   ,{"writeHexLower", buffer_write_hex_lower}
   ,{"writeHexUpper", buffer_write_hex_upper}
@@ -1101,10 +2211,44 @@ static luaL_reg methods[] = {
 static luaL_reg functions[] = {
   {"new", buffer_new}
   ,{"isBuffer", buffer_isbuffer}
+  ,{"needle", buffer_needle}
+  ,{"searchKernel", buffer_searchkernel}
+  ,{"format", buffer_format}
+  ,{"fromHex", buffer_fromhex}
+  ,{"fromBase64", buffer_frombase64}
+  ,{"codecKernel", buffer_codeckernel}
+  ,{"hasher", buffer_hasher}
+  ,{"hashKernel", buffer_hashkernel}
+  ,{ NULL, NULL }
+};
+
+static luaL_reg format_methods[] = {
+  {"size", format_size}
+  ,{ NULL, NULL }
+};
+
+static luaL_reg hasher_methods[] = {
+  {"update", hasher_update}
+  ,{"digest", hasher_digest}
   ,{ NULL, NULL }
 };
 
 void luaopen_lev_buffer(lua_State *L) {
+  luaL_newmetatable(L, "lev.needle");
+  lua_pop(L, 1);
+
+  luaL_newmetatable(L, "lev.format");
+  luaL_register(L, NULL, format_methods);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
+  luaL_newmetatable(L, "lev.hasher");
+  luaL_register(L, NULL, hasher_methods);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
   luaL_newmetatable(L, "lev.buffer");
   luaL_register(L, NULL, methods);
   lua_setfield(L, -1, "__index");
@@ -0,0 +1,513 @@
+/*
+ *  Copyright 2012 connectFree k.k. and the lev authors. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#include "lev_new_base.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+#include "luv_debug.h"
+
+/*
+
+  lev.bufferlist -- an ordered chain of MemSlices.
+
+  Appending a buffer only takes a reference on its MemBlock; nothing is
+  copied until the caller asks for a flat view (flatten/take/toString).
+  tcp and pipe writes submit the chunks directly as an iovec.
+
+*/
+
+#define BL_MIN_CHUNKS 8
+
+struct _lev_bufferlist {
+  MemSlice *chunks; /* chunks[head .. head+count-1] are in use */
+  int head;
+  int count;
+  int cap;
+  size_t length;    /* total bytes in all chunks */
+};
+
+#define BL_CHUNK(bl, i) (&(bl)->chunks[(bl)->head + (i)])
+
+#define BUFFERLIST_UDATA(L) \
+  lev_bufferlist_t *bl = luaL_checkudata(L, 1, "lev.bufferlist");
+
+lev_bufferlist_t *lev_tobufferlist(lua_State *L, int index) {
+  void *p = lua_touserdata(L, index);
+
+  if (p && lua_getmetatable(L, index)) {
+    luaL_getmetatable(L, "lev.bufferlist");
+    if (!lua_rawequal(L, -1, -2)) {
+      p = NULL;
+    }
+    lua_pop(L, 2);
+    return p;
+  }
+  return NULL;
+}
+
+/* make room for one more chunk at the front or the back */
+static void _bl_reserve(lua_State *L, lev_bufferlist_t *bl, int front) {
+  int cap;
+  int head;
+  MemSlice *chunks;
+
+  if (front ? bl->head > 0 : bl->head + bl->count < bl->cap) {
+    return;
+  }
+
+  cap = bl->cap;
+  if (bl->count + 1 > cap / 2) { /* more than half full: grow, otherwise just recenter */
+    cap = cap ? cap * 2 : BL_MIN_CHUNKS;
+  }
+  head = front ? cap - bl->count - (cap - bl->count) / 2 : (cap - bl->count) / 4;
+
+  chunks = malloc(cap * sizeof(MemSlice));
+  if (!chunks) {
+    luaL_error(L, "cannot allocate a bufferlist of %d chunks", cap);
+  }
+  if (bl->count) {
+    memcpy(chunks + head, bl->chunks + bl->head, bl->count * sizeof(MemSlice));
+  }
+  free(bl->chunks);
+  bl->chunks = chunks;
+  bl->head = head;
+  bl->cap = cap;
+}
+
+static void _bl_push(lua_State *L, lev_bufferlist_t *bl, MemBlock *mb, unsigned char *slice, size_t until, int front) {
+  MemSlice *ms;
+
+  if (!until) {
+    return;
+  }
+  _bl_reserve(L, bl, front);
+  if (front) {
+    bl->head--;
+    ms = BL_CHUNK(bl, 0);
+  } else {
+    ms = BL_CHUNK(bl, bl->count);
+  }
+  bl->count++;
+  bl->length += until;
+
+  lev_slab_incRef(mb);
+  ms->mb = mb;
+  ms->slice = slice;
+  ms->until = until;
+}
+
+/* push the value at index (buffer, string or bufferlist) onto either end */
+static int _bl_add(lua_State *L, lev_bufferlist_t *bl, int index, int front) {
+  lev_bufferlist_t *other;
+  MemSlice *ms;
+  const char *str;
+  size_t len;
+  int i, count;
+
+  if (LUA_TSTRING == lua_type(L, index)) {
+    str = lua_tolstring(L, index, &len);
+    if (len) {
+      ms = lev_buffer_new(L, len, str, len); /* packs small strings into a shared block */
+      _bl_push(L, bl, ms->mb, ms->slice, ms->until, front);
+      lua_pop(L, 1);
+    }
+    return 0;
+  }
+
+  other = lev_tobufferlist(L, index);
+  if (other) {
+    count = other->count; /* adding a list to itself must not loop forever */
+    for (i = 0; i < count; i++) {
+      if (!front) {
+        ms = BL_CHUNK(other, i);
+      } else if (other != bl) {
+        ms = BL_CHUNK(other, count - 1 - i);
+      } else { /* each prepend shifts our own chunks up by one */
+        ms = BL_CHUNK(other, count - 1);
+      }
+      _bl_push(L, bl, ms->mb, ms->slice, ms->until, front);
+    }
+    return 0;
+  }
+
+  ms = lev_checkbuffer(L, index);
+  _bl_push(L, bl, ms->mb, ms->slice, ms->until, front);
+  return 0;
+}
+
+/* drop n bytes from the front */
+static void _bl_drop(lev_bufferlist_t *bl, size_t n) {
+  MemSlice *ms;
+
+  while (n && bl->count) {
+    ms = BL_CHUNK(bl, 0);
+    if (n < ms->until) {
+      ms->slice += n;
+      ms->until -= n;
+      bl->length -= n;
+      return;
+    }
+    n -= ms->until;
+    bl->length -= ms->until;
+    lev_slab_decRef(ms->mb);
+    bl->head++;
+    bl->count--;
+  }
+}
+
+/* copy the first n bytes into dst */
+static void _bl_copy(lev_bufferlist_t *bl, unsigned char *dst, size_t n) {
+  MemSlice *ms;
+  size_t len;
+  int i;
+
+  for (i = 0; n && i < bl->count; i++) {
+    ms = BL_CHUNK(bl, i);
+    len = n < ms->until ? n : ms->until;
+    memcpy(dst, ms->slice, len);
+    dst += len;
+    n -= len;
+  }
+}
+
+/* does needle match starting at offset off of chunk i? may span chunks */
+static int _bl_match(lev_bufferlist_t *bl, int i, size_t off, const unsigned char *needle, size_t n) {
+  MemSlice *ms;
+  size_t len;
+
+  for (; i < bl->count; i++, off = 0) {
+    ms = BL_CHUNK(bl, i);
+    len = ms->until - off;
+    if (len > n) {
+      len = n;
+    }
+    if (memcmp(ms->slice + off, needle, len)) {
+      return 0;
+    }
+    needle += len;
+    n -= len;
+    if (!n) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static const unsigned char *_bl_checkneedle(lua_State *L, int index, size_t *len) {
+  MemSlice *ms;
+
+  if (LUA_TSTRING == lua_type(L, index)) {
+    return (const unsigned char *)lua_tolstring(L, index, len);
+  }
+  ms = lev_checkbuffer(L, index);
+  *len = ms->until;
+  return ms->slice;
+}
+
+/* push a lev.buffer holding the first n bytes; zero-copy when they sit in one chunk */
+static void _bl_pushfront(lua_State *L, lev_bufferlist_t *bl, size_t n) {
+  MemSlice *ms = BL_CHUNK(bl, 0);
+  MemSlice *flat;
+
+  if (n <= ms->until) {
+    lev_pushbuffer_from_mb(L, ms->mb, n, ms->slice);
+    return;
+  }
+  flat = lev_buffer_new(L, n, NULL, 0);
+  _bl_copy(bl, flat->slice, n);
+}
+
+/******************************************************************************/
+
+/* new([item, ...]) */
+static int bufferlist_new(lua_State *L) {
+  lev_bufferlist_t *bl;
+  int top = lua_gettop(L);
+  int i = 1;
+
+  if (LUA_TTABLE == lua_type(L, 1)) { /* BufferList:new() */
+    i++;
+  }
+
+  bl = (lev_bufferlist_t *)lua_newuserdata(L, sizeof *bl);
+  memset(bl, 0, sizeof *bl);
+  luaL_getmetatable(L, "lev.bufferlist");
+  lua_setmetatable(L, -2);
+
+  for (; i <= top; i++) {
+    _bl_add(L, bl, i, 0);
+  }
+
+  return 1;
+}
+
+/* append(bufferlist, item, ...) -> bufferlist */
+static int bufferlist_append(lua_State *L) {
+  BUFFERLIST_UDATA(L)
+  int top = lua_gettop(L);
+  int i;
+
+  for (i = 2; i <= top; i++) {
+    _bl_add(L, bl, i, 0);
+  }
+  lua_settop(L, 1);
+  return 1;
+}
+
+/* prepend(bufferlist, item, ...) -> bufferlist; items keep their order */
+static int bufferlist_prepend(lua_State *L) {
+  BUFFERLIST_UDATA(L)
+  int i;
+
+  for (i = lua_gettop(L); i >= 2; i--) {
+    _bl_add(L, bl, i, 1);
+  }
+  lua_settop(L, 1);
+  return 1;
+}
+
+/* find(bufferlist, needle, init) -> position or nil */
+static int bufferlist_find(lua_State *L) {
+  BUFFERLIST_UDATA(L)
+  const unsigned char *needle;
+  unsigned char *p;
+  MemSlice *ms;
+  size_t n, base, off;
+  size_t init;
+  int i;
+
+  needle = _bl_checkneedle(L, 2, &n);
+  init = (size_t)luaL_optinteger(L, 3, 1);
+  if (init < 1) {
+    init = 1;
+  }
+  init--;
+
+  if (!n) { /* same as buffer:find('') */
+    return 0;
+  }
+
+  for (i = 0, base = 0; i < bl->count; base += ms->until, i++) {
+    ms = BL_CHUNK(bl, i);
+    if (base + ms->until <= init) {
+      continue;
+    }
+    off = init > base ? init - base : 0;
+    while (off < ms->until) {
+      p = memchr(ms->slice + off, needle[0], ms->until - off);
+      if (!p) {
+        break;
+      }
+      off = p - ms->slice;
+      if (_bl_match(bl, i, off, needle, n)) {
+        lua_pushinteger(L, base + off + 1);
+        return 1;
+      }
+      off++;
+    }
+  }
+
+  return 0;
+}
+
+/* consume(bufferlist, n) -- drop n bytes from the front */
+static int bufferlist_consume(lua_State *L) {
+  BUFFERLIST_UDATA(L)
+  size_t n = (size_t)luaL_checkinteger(L, 2);
+
+  if (n > bl->length) {
+    return luaL_argerror(L, 2, "length out of bounds");
+  }
+  _bl_drop(bl, n);
+  return 0;
+}
+
+/* take(bufferlist, n) -> buffer -- remove and return the first n bytes */
+static int bufferlist_take(lua_State *L) {
+  BUFFERLIST_UDATA(L)
+  size_t n = (size_t)luaL_optinteger(L, 2, bl->length);
+
+  if (n > bl->length) {
+    return luaL_argerror(L, 2, "length out of bounds");
+  }
+  if (!n) {
+    return 0;
+  }
+  _bl_pushfront(L, bl, n);
+  _bl_drop(bl, n);
+  return 1;
+}
+
+/* flatten(bufferlist) -> buffer -- copies at most once; the list keeps the flat chunk */
+static int bufferlist_flatten(lua_State *L) {
+  BUFFERLIST_UDATA(L)
+  MemSlice *flat;
+  size_t length = bl->length;
+
+  if (!length) {
+    return 0;
+  }
+  _bl_pushfront(L, bl, length);
+  if (bl->count > 1) {
+    flat = lev_checkbuffer(L, -1);
+    _bl_drop(bl, length);
+    _bl_push(L, bl, flat->mb, flat->slice, flat->until, 0);
+  }
+  return 1;
+}
+
+/* buffers(bufferlist) -> { buffer, ... } without copying */
+static int bufferlist_buffers(lua_State *L) {
+  BUFFERLIST_UDATA(L)
+  MemSlice *ms;
+  int i;
+
+  lua_createtable(L, bl->count, 0);
+  for (i = 0; i < bl->count; i++) {
+    ms = BL_CHUNK(bl, i);
+    lev_pushbuffer_from_mb(L, ms->mb, ms->until, ms->slice);
+    lua_rawseti(L, -2, i + 1);
+  }
+  return 1;
+}
+
+/* count(bufferlist) -> number of chunks */
+static int bufferlist_count(lua_State *L) {
+  BUFFERLIST_UDATA(L)
+  lua_pushinteger(L, bl->count);
+  return 1;
+}
+
+/* clear(bufferlist) */
+static int bufferlist_clear(lua_State *L) {
+  BUFFERLIST_UDATA(L)
+  _bl_drop(bl, bl->length);
+  bl->head = 0;
+  return 0;
+}
+
+/* tostring(bufferlist) */
+static int bufferlist_tostring(lua_State *L) {
+  BUFFERLIST_UDATA(L)
+  luaL_Buffer b;
+  MemSlice *ms;
+  int i;
+
+  luaL_buffinit(L, &b);
+  for (i = 0; i < bl->count; i++) {
+    ms = BL_CHUNK(bl, i);
+    luaL_addlstring(&b, (const char *)ms->slice, ms->until);
+  }
+  luaL_pushresult(&b);
+  return 1;
+}
+
+/* __len(bufferlist) */
+static int bufferlist__len(lua_State *L) {
+  BUFFERLIST_UDATA(L)
+  lua_pushinteger(L, bl->length);
+  return 1;
+}
+
+/* __gc(bufferlist) */
+static int bufferlist__gc(lua_State *L) {
+  BUFFERLIST_UDATA(L)
+  _bl_drop(bl, bl->length);
+  free(bl->chunks);
+  bl->chunks = NULL;
+  return 0;
+}
+
+/******************************************************************************/
+
+/*
+  build a write request whose iovec points straight at the chunks. every
+  MemBlock is pinned until lev_writev_done(), so the list may be consumed
+  or collected while the write is in flight.
+*/
+lev_writev_t *lev_bufferlist_writev(lua_State *L, lev_bufferlist_t *bl) {
+  lev_writev_t *w;
+  MemSlice *ms;
+  int i;
+
+  w = malloc(sizeof(lev_writev_t) + bl->count * (sizeof(uv_buf_t) + sizeof(MemBlock *)));
+  if (!w) {
+    luaL_error(L, "cannot allocate a write request of %d chunks", bl->count);
+  }
+  w->bufs = (uv_buf_t *)(w + 1);
+  w->mbs = (MemBlock **)(w->bufs + bl->count);
+  w->bufcnt = bl->count;
+
+  for (i = 0; i < bl->count; i++) {
+    ms = BL_CHUNK(bl, i);
+    w->bufs[i] = uv_buf_init((char *)ms->slice, ms->until);
+    w->mbs[i] = ms->mb;
+    lev_slab_incRef(ms->mb);
+  }
+  return w;
+}
+
+void lev_writev_done(lev_writev_t *w) {
+  int i;
+
+  for (i = 0; i < w->bufcnt; i++) {
+    lev_slab_decRef(w->mbs[i]);
+  }
+  free(w);
+}
+
+static luaL_reg methods[] = {
+   { "append",     bufferlist_append   }
+  ,{ "prepend",    bufferlist_prepend  }
+  ,{ "find",       bufferlist_find     }
+  ,{ "consume",    bufferlist_consume  }
+  ,{ "take",       bufferlist_take     }
+  ,{ "flatten",    bufferlist_flatten  }
+  ,{ "buffers",    bufferlist_buffers  }
+  ,{ "count",      bufferlist_count    }
+  ,{ "clear",      bufferlist_clear    }
+  ,{ "toString",   bufferlist_tostring }
+
+   /* meta */
+  ,{ "__gc",       bufferlist__gc      }
+  ,{ "__len",      bufferlist__len     }
+  ,{ "__tostring", bufferlist_tostring }
+  ,{ NULL, NULL }
+};
+
+
+static luaL_reg functions[] = {
+   { "new", bufferlist_new }
+  ,{ NULL, NULL }
+};
+
+
+void luaopen_lev_bufferlist(lua_State *L) {
+  luaL_newmetatable(L, "lev.bufferlist");
+  luaL_register(L, NULL, methods);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
+  lua_createtable(L, 0, ARRAY_SIZE(functions) - 1);
+  luaL_register(L, NULL, functions);
+  lua_setfield(L, -2, "bufferlist");
+}
@@ -0,0 +1,374 @@
+/*
+ *  Copyright 2012 connectFree k.k. and the lev authors. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#include "lev_new_base.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+#include "luv_debug.h"
+
+/*
+
+  lev.bufferwriter -- a growable MemSlice for building output.
+
+  Bytes go straight into a slab block through the lev_memslice_* helpers
+  the JSON encoder uses; the capacity at least doubles when it runs out,
+  and stays in place while the block has room. finish() hands the block
+  over as a lev.buffer without copying and leaves the writer empty.
+
+*/
+
+#define BW_DEFAULT_SIZE 1024
+#define BW_SPEC_MAX     32 /* longest "%-+ #0<width>.<precision>ll<conv>" we pass on */
+
+typedef struct _lev_bufferwriter {
+  MemSlice ms;   /* ms.mb is NULL until the first write */
+  size_t length; /* bytes written */
+} lev_bufferwriter_t;
+
+#define BUFFERWRITER_UDATA(L) \
+  lev_bufferwriter_t *bw = luaL_checkudata(L, 1, "lev.bufferwriter");
+
+/* room for n more bytes; lev_memslice_empty_length() keeps one for a NUL */
+static unsigned char *_bw_reserve(lua_State *L, lev_bufferwriter_t *bw, size_t n) {
+  MemBlock *mb;
+  size_t capacity;
+
+  if (!bw->ms.mb) {
+    capacity = n > BW_DEFAULT_SIZE ? n : BW_DEFAULT_SIZE;
+    mb = lev_slab_getBlock(capacity + 1);
+    if (!mb) {
+      luaL_error(L, "cannot allocate a bufferwriter of %d bytes", (int)capacity);
+    }
+    lev_slab_incRef(mb);
+    mb->nbytes = capacity + 1;
+    bw->ms.mb = mb;
+    bw->ms.slice = mb->bytes;
+    bw->ms.until = capacity + 1;
+  } else if (bw->length + n > lev_memslice_empty_length(&bw->ms)) {
+    capacity = lev_memslice_empty_length(&bw->ms) * 2;
+    if (capacity < bw->length + n) {
+      capacity = bw->length + n;
+    }
+    if (lev_memslice_resize(&bw->ms, capacity)) {
+      luaL_error(L, "cannot grow a bufferwriter to %d bytes", (int)capacity);
+    }
+  }
+  return bw->ms.slice + bw->length;
+}
+
+static void _bw_append(lua_State *L, lev_bufferwriter_t *bw, const void *bytes, size_t len) {
+  memcpy(_bw_reserve(L, bw, len), bytes, len);
+  bw->length += len;
+}
+
+static void _bw_release(lev_bufferwriter_t *bw) {
+  if (bw->ms.mb) {
+    lev_slab_decRef(bw->ms.mb);
+  }
+  bw->ms.mb = NULL;
+  bw->ms.slice = NULL;
+  bw->ms.until = 0;
+  bw->length = 0;
+}
+
+/* append the string, buffer or number at index */
+static void _bw_add(lua_State *L, lev_bufferwriter_t *bw, int index) {
+  char number[32];
+  const char *str;
+  MemSlice *ms;
+  size_t len;
+
+  switch (lua_type(L, index)) {
+    case LUA_TNUMBER:
+      len = snprintf(number, sizeof(number), LUA_NUMBER_FMT, lua_tonumber(L, index));
+      _bw_append(L, bw, number, len);
+      break;
+    case LUA_TSTRING:
+      str = lua_tolstring(L, index, &len);
+      _bw_append(L, bw, str, len);
+      break;
+    default:
+      ms = lev_checkbuffer(L, index);
+      _bw_append(L, bw, ms->slice, ms->until);
+  }
+}
+
+/* new([size]) -> bufferwriter; size is a capacity hint */
+static int bufferwriter_new(lua_State *L) {
+  lev_bufferwriter_t *bw;
+  int index = 1;
+  size_t size;
+
+  if (lua_gettop(L) > 0 && LUA_TTABLE == lua_type(L, 1)) { /* BufferWriter:new() */
+    index++;
+  }
+  size = (size_t)luaL_optinteger(L, index, 0);
+
+  bw = (lev_bufferwriter_t *)lua_newuserdata(L, sizeof *bw);
+  memset(bw, 0, sizeof *bw);
+  luaL_getmetatable(L, "lev.bufferwriter");
+  lua_setmetatable(L, -2);
+
+  if (size) {
+    _bw_reserve(L, bw, size);
+  }
+  return 1;
+}
+
+/* append(bufferwriter, ...) -> bufferwriter -- strings, buffers and numbers */
+static int bufferwriter_append(lua_State *L) {
+  BUFFERWRITER_UDATA(L)
+  int top = lua_gettop(L);
+  int i;
+
+  for (i = 2; i <= top; i++) {
+    _bw_add(L, bw, i);
+  }
+  lua_settop(L, 1);
+  return 1;
+}
+
+/* one conversion of appendf(); spec is "%...c" and NUL terminated */
+static void _bw_format(lua_State *L, lev_bufferwriter_t *bw, char *spec, size_t spec_len, int arg) {
+  char conv = spec[spec_len - 1];
+  const char *str = NULL;
+  size_t len, room;
+  MemSlice *ms;
+  double number = 0;
+  int n;
+
+  if (conv == 's' && spec_len == 2) { /* plain %s: copy, embedded zeros and all */
+    if (LUA_TUSERDATA == lua_type(L, arg)) {
+      ms = lev_checkbuffer(L, arg);
+      _bw_append(L, bw, ms->slice, ms->until);
+    } else {
+      str = luaL_checklstring(L, arg, &len);
+      _bw_append(L, bw, str, len);
+    }
+    return;
+  }
+
+  switch (conv) {
+    case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+      number = luaL_checknumber(L, arg);
+      if (conv != 'c') { /* widen to long long: "%5d" -> "%5lld" */
+        spec[spec_len + 1] = conv;
+        spec[spec_len - 1] = 'l';
+        spec[spec_len] = 'l';
+        spec[spec_len + 2] = 0;
+      }
+      break;
+    case 'e': case 'E': case 'f': case 'g': case 'G':
+      number = luaL_checknumber(L, arg);
+      break;
+    case 's':
+      str = luaL_checklstring(L, arg, &len);
+      break;
+    default:
+      luaL_error(L, "invalid option '%%%c' to 'appendf'", conv);
+      return;
+  }
+
+  /* format in place; if it did not fit, grow to the reported size and redo */
+  _bw_reserve(L, bw, 0);
+  room = lev_memslice_empty_length(&bw->ms) - bw->length;
+  for (;;) {
+    unsigned char *at = _bw_reserve(L, bw, room);
+    switch (conv) {
+      case 's':
+        n = snprintf((char *)at, room + 1, spec, str);
+        break;
+      case 'c':
+        n = snprintf((char *)at, room + 1, spec, (int)number);
+        break;
+      case 'e': case 'E': case 'f': case 'g': case 'G':
+        n = snprintf((char *)at, room + 1, spec, number);
+        break;
+      default:
+        if (conv == 'd' || conv == 'i') {
+          n = snprintf((char *)at, room + 1, spec, (long long)number);
+        } else {
+          n = snprintf((char *)at, room + 1, spec, (unsigned long long)(long long)number);
+        }
+    }
+    if (n < 0) {
+      luaL_error(L, "bad format '%s' in 'appendf'", spec);
+    }
+    if ((size_t)n <= room) {
+      bw->length += n;
+      return;
+    }
+    room = n;
+  }
+}
+
+/*
+  appendf(bufferwriter, fmt, ...) -> bufferwriter
+  string.format() conversions (%d %i %o %u %x %X %c %e %E %f %g %G %s
+  and %%, with flags, width and precision) formatted straight into the
+  writer. %s also takes a buffer.
+*/
+static int bufferwriter_appendf(lua_State *L) {
+  BUFFERWRITER_UDATA(L)
+  char spec[BW_SPEC_MAX + 3];
+  const char *fmt, *end, *run;
+  size_t fmt_len, spec_len;
+  int arg = 3;
+
+  fmt = luaL_checklstring(L, 2, &fmt_len);
+  end = fmt + fmt_len;
+
+  while (fmt < end) {
+    run = fmt;
+    while (fmt < end && *fmt != '%') {
+      fmt++;
+    }
+    if (fmt > run) {
+      _bw_append(L, bw, run, fmt - run);
+    }
+    if (fmt == end) {
+      break;
+    }
+
+    if (++fmt < end && *fmt == '%') {
+      _bw_append(L, bw, "%", 1);
+      fmt++;
+      continue;
+    }
+    spec[0] = '%';
+    spec_len = 1;
+    while (fmt < end && *fmt && strchr("-+ #0.123456789", *fmt)) {
+      if (spec_len == BW_SPEC_MAX - 1) {
+        return luaL_error(L, "invalid format (too long) in 'appendf'");
+      }
+      spec[spec_len++] = *fmt++;
+    }
+    if (fmt == end) {
+      return luaL_error(L, "invalid format (missing conversion) in 'appendf'");
+    }
+    spec[spec_len++] = *fmt++;
+    spec[spec_len] = 0;
+
+    if (arg > lua_gettop(L)) {
+      return luaL_argerror(L, arg, "no value");
+    }
+    _bw_format(L, bw, spec, spec_len, arg++);
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+/* reserve(bufferwriter, n) -> bufferwriter -- room for n more bytes */
+static int bufferwriter_reserve(lua_State *L) {
+  BUFFERWRITER_UDATA(L)
+  lua_Integer n = luaL_checkinteger(L, 2);
+
+  if (n < 0) {
+    return luaL_argerror(L, 2, "must not be negative");
+  }
+  _bw_reserve(L, bw, (size_t)n);
+  lua_settop(L, 1);
+  return 1;
+}
+
+/* finish(bufferwriter) -> buffer -- no copy; the writer starts over empty */
+static int bufferwriter_finish(lua_State *L) {
+  BUFFERWRITER_UDATA(L)
+  MemSlice *ms;
+
+  _bw_reserve(L, bw, 0);
+  lev_pushbuffer_from_mb(L, bw->ms.mb, bw->length, bw->ms.slice);
+  ms = lua_touserdata(L, -1);
+  lev_buffer_set_length(ms, bw->length); /* 0 would mean the whole block otherwise */
+  _bw_release(bw);
+  return 1;
+}
+
+/* capacity(bufferwriter) -> bytes that fit before the next grow */
+static int bufferwriter_capacity(lua_State *L) {
+  BUFFERWRITER_UDATA(L)
+  lua_pushinteger(L, bw->ms.mb ? lev_memslice_empty_length(&bw->ms) : 0);
+  return 1;
+}
+
+/* clear(bufferwriter) -- drop the contents, keep the block */
+static int bufferwriter_clear(lua_State *L) {
+  BUFFERWRITER_UDATA(L)
+  bw->length = 0;
+  return 0;
+}
+
+/* tostring(bufferwriter) -- a copy of what was written so far */
+static int bufferwriter_tostring(lua_State *L) {
+  BUFFERWRITER_UDATA(L)
+  lua_pushlstring(L, bw->ms.mb ? (const char *)bw->ms.slice : "", bw->length);
+  return 1;
+}
+
+/* __len(bufferwriter) */
+static int bufferwriter__len(lua_State *L) {
+  BUFFERWRITER_UDATA(L)
+  lua_pushinteger(L, bw->length);
+  return 1;
+}
+
+/* __gc(bufferwriter) */
+static int bufferwriter__gc(lua_State *L) {
+  BUFFERWRITER_UDATA(L)
+  _bw_release(bw);
+  return 0;
+}
+
+static luaL_reg methods[] = {
+   { "append",     bufferwriter_append   }
+  ,{ "appendf",    bufferwriter_appendf  }
+  ,{ "reserve",    bufferwriter_reserve  }
+  ,{ "finish",     bufferwriter_finish   }
+  ,{ "capacity",   bufferwriter_capacity }
+  ,{ "clear",      bufferwriter_clear    }
+  ,{ "toString",   bufferwriter_tostring }
+
+   /* meta */
+  ,{ "__gc",       bufferwriter__gc      }
+  ,{ "__len",      bufferwriter__len     }
+  ,{ "__tostring", bufferwriter_tostring }
+  ,{ NULL, NULL }
+};
+
+static luaL_reg functions[] = {
+   { "new", bufferwriter_new }
+  ,{ NULL, NULL }
+};
+
+
+void luaopen_lev_bufferwriter(lua_State *L) {
+  luaL_newmetatable(L, "lev.bufferwriter");
+  luaL_register(L, NULL, methods);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
+  lua_createtable(L, 0, ARRAY_SIZE(functions) - 1);
+  luaL_register(L, NULL, functions);
+  lua_setfield(L, -2, "bufferwriter");
+}
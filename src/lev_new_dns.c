@@ -51,7 +51,7 @@ typedef struct dns_req_holder_s {
   dns_req_holder_t *holder = (dns_req_holder_t *)(h); \
   lua_State* L = holder->L;
 
-#define DNSR__CBNAME "_cb"
+#define DNSR__CBNAME LEV_CB_REQUEST
 
 #define DNSR__SETUP \
   dns_req_holder_t *holder;
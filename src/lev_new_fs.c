@@ -43,7 +43,7 @@ typedef struct fs_req_holder_s {
   lua_State* L = holder->_L;                                         \
 
 
-#define FSR__CBNAME "_cb"
+#define FSR__CBNAME LEV_CB_REQUEST
 
 #define FSR__SETUP \
   uv_fs_cb cb = NULL;                                                 \
@@ -300,6 +300,9 @@ static inline void memslice_wrap_strbuf_init(strbuf_t *s, int len) {
 
   /* issue MemBlock and MemSlice */
   mb = lev_slab_getBlock( size );
+  if (!mb) {
+    die("Out of memory");
+  }
   lev_slab_incRef( mb );
 
   s->ms = malloc(sizeof *s->ms);
@@ -341,6 +344,13 @@ static inline void memslice_wrap_strbuf_free(strbuf_t *s) {
   }
 }
 
+/* the MemSlice could not grow; strbuf gave up the same way */
+static inline void memslice_wrap_strbuf_grown(int r) {
+  if (r) {
+    die("Out of memory");
+  }
+}
+
 static inline char *memslice_wrap_strbuf_string(strbuf_t *s, int *len){
   if (len) {
     *len = s->length;
@@ -355,12 +365,12 @@ static inline char *memslice_wrap_strbuf_string(strbuf_t *s, int *len){
 #define strbuf_empty_ptr(s)                lev_memslice_empty_ptr(s->ms, s->length)
 #define strbuf_ensure_null(s)              lev_memslice_ensure_null(s->ms, s->length)
 #define strbuf_string(s, len)              memslice_wrap_strbuf_string(s, len)
-#define strbuf_append_char(s, c)           lev_memslice_append_char(s->ms, s->length, c); s->length++
-#define strbuf_append_mem(s, c, l)         lev_memslice_append_mem(s->ms, s->length, c, l); s->length += l
+#define strbuf_append_char(s, c)           memslice_wrap_strbuf_grown(lev_memslice_append_char(s->ms, s->length, c)); s->length++
+#define strbuf_append_mem(s, c, l)         memslice_wrap_strbuf_grown(lev_memslice_append_mem(s->ms, s->length, c, l)); s->length += l
 #define strbuf_append_string(s, c)         s->length += lev_memslice_append_string(s->ms, s->length, c)
 #define strbuf_extend_length(s, l)         s->length += l;
 #define strbuf_append_char_unsafe(s, c)    lev_memslice_append_char_unsafe(s->ms, s->length, c); s->length++
-#define strbuf_ensure_empty_length(s, l)   lev_memslice_ensure_empty_length(s->ms, s->length + l)
+#define strbuf_ensure_empty_length(s, l)   memslice_wrap_strbuf_grown(lev_memslice_ensure_empty_length(s->ms, s->length + l))
 #define strbuf_append_mem_unsafe(s, c, l)  lev_memslice_append_mem_unsafe(s->ms, s->length, c, l); s->length += l
 
 /* X:E support layer for MemBlocks */
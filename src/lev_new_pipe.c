@@ -46,11 +46,12 @@ typedef struct {
   LEVBASE_REF_FIELDS
   uv_pipe_t handle;
   uv_connect_t connect_req; /* TODO alloc on as needed basis */
+  lev_readsize_t readsize;
 } pipe_obj;
 
 static void pipe_after_close(uv_handle_t* handle) {
   UNWRAP(handle);
-  if (push_callback(L, self, "on_close")) {
+  if (push_callback(L, self, LEV_CB_CLOSE)) {
     lua_call(L, 1, 0);/*, -3*/
     
   }
@@ -68,7 +69,7 @@ void pipe_after_shutdown(uv_shutdown_t* req, int status) {
 static void on_connect(uv_connect_t* req, int status) {
   UNWRAP(req->handle);
   lev_handle_unref(L, (LevRefStruct_t*)self);
-  push_callback(L, self, "on_connect");
+  push_callback(L, self, LEV_CB_CONNECT);
   if (!status) {
     lua_pushnil(L);
   } else {
@@ -80,7 +81,7 @@ static void on_connect(uv_connect_t* req, int status) {
 
 static void on_connection(uv_stream_t* handle, int status) {
   UNWRAP(handle);
-  push_callback(L, self, "on_connection");
+  push_callback(L, self, LEV_CB_CONNECTION);
   if (!status) {
     lua_pushnil(L);
   } else {
@@ -95,7 +96,7 @@ static void on_read(uv_stream_t* handle, ssize_t nread, uv_buf_t buf) {
     lev_pushbuffer_from_static_mb(L, nread); /* won't actually push -- used to clean-up! */
     UV_CLOSE_CLIENT
   } else {
-    push_callback(L, self, "on_read");
+    push_callback(L, self, LEV_CB_READ);
     lua_pushinteger(L, nread);
 
     lev_pushbuffer_from_static_mb(L, nread);
@@ -113,7 +114,7 @@ static void on_read2(uv_pipe_t* handle, ssize_t nread, uv_buf_t buf,
     lev_pushbuffer_from_static_mb(L, nread); /* won't actually push -- used to clean-up! */
     UV_CLOSE_CLIENT
   } else {
-    push_callback(L, self, "on_read");
+    push_callback(L, self, LEV_CB_READ);
     lua_pushinteger(L, nread);
 
     lev_pushbuffer_from_static_mb(L, nread);
@@ -194,7 +195,7 @@ static int pipe_connect(lua_State* L) {
 
   self = luaL_checkudata(L, 1, "lev.pipe");
   name = luaL_checkstring(L, 2);
-  set_callback(L, "on_connect", 3);
+  set_callback(L, LEV_CB_CONNECT, 3);
 
   uv_pipe_connect(&self->connect_req, &self->handle, name, on_connect);
   lev_handle_ref(L, (LevRefStruct_t*)self, 1);
@@ -208,7 +209,7 @@ static int pipe_close(lua_State* L) {
   self = luaL_checkudata(L, 1, "lev.pipe");
 
   if (lua_isfunction(L, 2))
-    set_callback(L, "on_close", 2);
+    set_callback(L, LEV_CB_CLOSE, 2);
 
   UV_CLOSE_CLIENT
 
@@ -225,11 +226,11 @@ static int pipe_listen(lua_State* L) {
 
   if (lua_isnumber(L, 2)) {
     backlog = luaL_checkinteger(L, 2);
-    set_callback(L, "on_connection", 3);
+    set_callback(L, LEV_CB_CONNECTION, 3);
   }
   else {
     backlog = SOMAXCONN;
-    set_callback(L, "on_connection", 2);
+    set_callback(L, LEV_CB_CONNECTION, 2);
   }
 
   r = uv_listen((uv_stream_t*)&self->handle, backlog, on_connection);
@@ -245,7 +246,7 @@ static int pipe_listen(lua_State* L) {
 
 static int pipe_rcb_close(lua_State* L) {
   luaL_checkudata(L, 1, "lev.pipe"); /* we won't use the data, but check if it is actually lev.pipe*/
-  set_callback(L, "on_close", 2);
+  set_callback(L, LEV_CB_CLOSE, 2);
   return 0;
 }
 
@@ -254,8 +255,9 @@ static int pipe_read_start(lua_State* L) {
   int r;
 
   self = luaL_checkudata(L, 1, "lev.pipe");
-  set_callback(L, "on_read", 2);
+  set_callback(L, LEV_CB_READ, 2);
 
+  lev_readsize_start((uv_handle_t*)&self->handle, &self->readsize);
   if (self->handle.ipc) {
     r = uv_read2_start((uv_stream_t*)&self->handle, on_alloc, on_read2);
   } else {
@@ -289,11 +291,19 @@ static int pipe_read_stop(lua_State* L) {
   }
 
   if (r == 0)
-    clear_callback(L, "on_read", self);
+    clear_callback(L, LEV_CB_READ, self);
 
   return 1;
 }
 
+/* read_stats() -> { size = ..., reads = ..., bytes = ..., grows = ..., shrinks = ... } */
+static int pipe_read_stats(lua_State* L) {
+  pipe_obj* self = luaL_checkudata(L, 1, "lev.pipe");
+
+  lev_readsize_push(L, &self->readsize);
+  return 1;
+}
+
 void pipe_after_write(uv_write_t* req, int status) {
   UNWRAP(req->handle);
   if (req->send_handle) {
@@ -304,14 +314,34 @@ void pipe_after_write(uv_write_t* req, int status) {
 }
 
 
+void pipe_after_writev(uv_write_t* req, int status) {
+  UNWRAP(req->handle);
+  lev_handle_unref(L, (LevRefStruct_t*)self);
+  lev_writev_done((lev_writev_t*)req);
+}
+
 static int pipe_write(lua_State* L) {
   pipe_obj* self;
+  lev_bufferlist_t* bl;
+  lev_writev_t* w;
   uv_buf_t buf;
   size_t len;
   int fd_to_send;
 
   self = luaL_checkudata(L, 1, "lev.pipe");
 
+  bl = lev_tobufferlist(L, 2);
+  if (bl) { /* the whole chain in one iovec */
+    w = lev_bufferlist_writev(L, bl);
+    if (!w->bufcnt) {
+      lev_writev_done(w);
+      return 0;
+    }
+    uv_write(&w->req, (uv_stream_t*)&self->handle, w->bufs, w->bufcnt, pipe_after_writev);
+    lev_handle_ref(L, (LevRefStruct_t*)self, 1);
+    return 0;
+  }
+
   if (lua_isstring(L, 2)) {
     const char* chunk = luaL_checklstring(L, 2, &len);
     buf = uv_buf_init((char*)chunk, len);
@@ -346,6 +376,7 @@ static luaL_reg methods[] = {
   ,{ "on_close",     pipe_rcb_close    }
   ,{ "read_start",   pipe_read_start   }
   ,{ "read_stop",    pipe_read_stop    }
+  ,{ "read_stats",   pipe_read_stats   }
   ,{ "write",        pipe_write        }
   ,{ NULL,         NULL            }
 };
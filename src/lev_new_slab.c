@@ -0,0 +1,277 @@
+/*
+ *  Copyright 2012 connectFree k.k. and the lev authors. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#include "lev_new_base.h"
+
+#include <stdlib.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+#include "luv_debug.h"
+
+/*
+
+  Slab introspection -- lets each worker report how its MemBlock pools
+  are being used so that pool sizes can be tuned from real traffic.
+
+  A repeating (unref'd) timer drives lev_slab_tick() once per idle period,
+  which decays the pool targets and trims classes that went unused.
+
+  With LEV_SLAB_PREFILL=idle an (unref'd) idle handle warms the pools a
+  batch at a time whenever the loop has nothing better to do.
+
+  With LEV_SLAB_COMPACT=n (or configure({ compact = n })) an (unref'd)
+  check handle runs lev_buffer_sweep() every n loop iterations, moving
+  small long-lived slices off the large blocks they pin.
+
+*/
+
+static uv_timer_t slab_timer;
+static long slab_idle_ms = SLAB_DEFAULT_IDLE_MS;
+
+static void slab_on_timer(uv_timer_t *handle, int status) {
+  lev_slab_tick();
+}
+
+static uv_idle_t slab_warmer;
+
+static void slab_on_idle(uv_idle_t *handle, int status) {
+  if (!lev_slab_warm(SLAB_WARM_BATCH)) {
+    uv_idle_stop(handle);
+  }
+}
+
+static uv_check_t slab_compactor;
+static long slab_compact_every = 0; /* loop iterations between sweeps; 0 is off */
+static long slab_compact_countdown = 0;
+
+static void slab_on_check(uv_check_t *handle, int status) {
+  if (--slab_compact_countdown <= 0) {
+    slab_compact_countdown = slab_compact_every;
+    lev_buffer_sweep();
+  }
+}
+
+static void slab_compactor_restart() {
+  uv_check_stop(&slab_compactor);
+  lev_buffer_track(slab_compact_every > 0);
+  if (slab_compact_every > 0) {
+    slab_compact_countdown = slab_compact_every;
+    uv_check_start(&slab_compactor, slab_on_check);
+  }
+}
+
+static void slab_timer_restart() {
+  uv_timer_stop(&slab_timer);
+  if (slab_idle_ms > 0) {
+    uv_timer_start(&slab_timer, slab_on_timer, slab_idle_ms, slab_idle_ms);
+  }
+}
+
+static void slab_push_class_stats(lua_State* L, lev_slab_allocator_t *allocator) {
+  double served = (double)allocator->stats.served_bytes;
+
+  lua_createtable(L, 0, 17);
+  LEV_SET_FIELD(blocksize, number, allocator->blocksize);
+  LEV_SET_FIELD(hits, number, allocator->stats.hits);
+  LEV_SET_FIELD(misses, number, allocator->stats.misses);
+  LEV_SET_FIELD(frees, number, allocator->stats.frees);
+  LEV_SET_FIELD(live, number, allocator->stats.live);
+  LEV_SET_FIELD(live_bytes, number, allocator->stats.live_bytes);
+  LEV_SET_FIELD(high_water, number, allocator->stats.high_water);
+  LEV_SET_FIELD(pooled, number, allocator->pool_count);
+  LEV_SET_FIELD(pooled_bytes, number, (size_t)allocator->pool_count * allocator->blocksize);
+  LEV_SET_FIELD(pool_target, number, allocator->pool_target);
+  LEV_SET_FIELD(peak, number, allocator->peak);
+  LEV_SET_FIELD(trimmed, number, allocator->stats.trimmed);
+  LEV_SET_FIELD(released, number, allocator->released_count);
+  LEV_SET_FIELD(mapped_bytes, number, allocator->stats.mapped_bytes);
+  LEV_SET_FIELD(requested_bytes, number, allocator->stats.requested_bytes);
+  LEV_SET_FIELD(served_bytes, number, allocator->stats.served_bytes);
+  /* internal fragmentation: share of served block bytes nobody asked for */
+  LEV_SET_FIELD(fragmentation, number,
+    served > 0 ? 1.0 - (double)allocator->stats.requested_bytes / served : 0);
+}
+
+/* stats() -> { ["1k"] = { hits = ..., misses = ..., ... }, ... } */
+static int slab_stats(lua_State* L) {
+  lev_slab_allocator_t *allocator;
+  int i;
+
+  lua_createtable(L, 0, lev_slab_class_count());
+  for (i = 0; (allocator = lev_slab_class(i)); i++) {
+    slab_push_class_stats(L, allocator);
+    lua_setfield(L, -2, allocator->name);
+  }
+
+  return 1;
+}
+
+/*
+  retention() -> { blocks = ..., retained_bytes = ..., sliced_bytes = ..., ... }
+  what live lev.buffer objects keep alive: retained_bytes is the size of
+  every block with a buffer on it, sliced_bytes what the buffers show.
+*/
+static int slab_retention(lua_State* L) {
+  lev_slab_retention_t *retention = lev_slab_retention();
+  double retained = (double)retention->retained_bytes;
+
+  lua_createtable(L, 0, 7);
+  LEV_SET_FIELD(blocks, number, retention->blocks);
+  LEV_SET_FIELD(retained_bytes, number, retention->retained_bytes);
+  LEV_SET_FIELD(sliced_bytes, number, retention->sliced_bytes);
+  /* share of the retained bytes no buffer can see (overlapping slices can make it negative) */
+  LEV_SET_FIELD(waste, number,
+    retained > 0 ? 1.0 - (double)retention->sliced_bytes / retained : 0);
+  LEV_SET_FIELD(compactions, number, retention->compactions);
+  LEV_SET_FIELD(compacted_bytes, number, retention->compacted_bytes);
+  LEV_SET_FIELD(tracked, number, lev_buffer_tracked());
+
+  return 1;
+}
+
+/* classes() -> { "1k", "8k", ... } in ascending block size */
+static int slab_classes(lua_State* L) {
+  lev_slab_allocator_t *allocator;
+  int i;
+
+  lua_createtable(L, lev_slab_class_count(), 0);
+  for (i = 0; (allocator = lev_slab_class(i)); i++) {
+    lua_pushstring(L, allocator->name);
+    lua_rawseti(L, -2, i + 1);
+  }
+
+  return 1;
+}
+
+/*
+  histogram() -> { [1024] = n, [2048] = n, ... }
+  requested sizes bucketed by the next power of two; only non-empty
+  buckets are present. the largest key also counts everything above it.
+*/
+static int slab_histogram(lua_State* L) {
+  size_t count;
+  int i;
+
+  lua_newtable(L);
+  for (i = 0; i < SLAB_HISTOGRAM_BUCKETS; i++) {
+    count = lev_slab_histogram(i);
+    if (count) {
+      lua_pushnumber(L, (double)((uint32_t)1 << i));
+      lua_pushnumber(L, count);
+      lua_rawset(L, -3);
+    }
+  }
+
+  return 1;
+}
+
+/* backend() -> "malloc" | "arena" | "arena+hugetlb" */
+static int slab_backend(lua_State* L) {
+  lua_pushstring(L, lev_slab_backend_name());
+  return 1;
+}
+
+/* configure({ idle = ms, decay = 0..1, compact = iterations }) */
+static int slab_configure(lua_State* L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+
+  lua_getfield(L, 1, "decay");
+  if (!lua_isnil(L, -1)) {
+    lev_slab_configure(luaL_checknumber(L, -1));
+  }
+  lua_pop(L, 1);
+
+  lua_getfield(L, 1, "idle");
+  if (!lua_isnil(L, -1)) {
+    slab_idle_ms = (long)luaL_checkinteger(L, -1);
+    slab_timer_restart();
+  }
+  lua_pop(L, 1);
+
+  lua_getfield(L, 1, "compact");
+  if (!lua_isnil(L, -1)) {
+    slab_compact_every = (long)luaL_checkinteger(L, -1);
+    slab_compactor_restart();
+  }
+  lua_pop(L, 1);
+
+  return 0;
+}
+
+/* warm([budget]) -> pending -- allocate up to budget blocks towards the prefill counts */
+static int slab_warm(lua_State* L) {
+  int budget = (int)luaL_optinteger(L, 1, SLAB_WARM_BATCH);
+  lua_pushboolean(L, lev_slab_warm(budget));
+  return 1;
+}
+
+/* compact() -> moved -- sweep the tracked slices now */
+static int slab_compact(lua_State* L) {
+  lua_pushinteger(L, lev_buffer_sweep());
+  return 1;
+}
+
+/* trim() -- hand every pooled block back to the OS now */
+static int slab_trim(lua_State* L) {
+  lev_slab_trim();
+  return 0;
+}
+
+static luaL_reg functions[] = {
+   { "stats",     slab_stats     }
+  ,{ "backend",   slab_backend   }
+  ,{ "classes",   slab_classes   }
+  ,{ "histogram", slab_histogram }
+  ,{ "retention", slab_retention }
+  ,{ "configure", slab_configure }
+  ,{ "trim",      slab_trim      }
+  ,{ "compact",   slab_compact   }
+  ,{ "warm",      slab_warm      }
+  ,{ NULL, NULL }
+};
+
+
+void luaopen_lev_slab(lua_State *L) {
+  const char *idle_ms = getenv("LEV_SLAB_IDLE_MS");
+  if (idle_ms) {
+    slab_idle_ms = atol(idle_ms);
+  }
+
+  uv_timer_init(lev_get_loop(L), &slab_timer);
+  uv_unref((uv_handle_t*)&slab_timer);
+  slab_timer_restart();
+
+  const char *compact = getenv("LEV_SLAB_COMPACT");
+  if (compact) {
+    slab_compact_every = atol(compact);
+  }
+
+  uv_check_init(lev_get_loop(L), &slab_compactor);
+  uv_unref((uv_handle_t*)&slab_compactor);
+  slab_compactor_restart();
+
+  if (lev_slab_prefill_mode() == LEV_SLAB_PREFILL_IDLE) {
+    uv_idle_init(lev_get_loop(L), &slab_warmer);
+    uv_unref((uv_handle_t*)&slab_warmer);
+    uv_idle_start(&slab_warmer, slab_on_idle);
+  }
+
+  lua_createtable(L, 0, ARRAY_SIZE(functions) - 1);
+  luaL_register(L, NULL, functions);
+  lua_setfield(L, -2, "slab");
+}
@@ -20,6 +20,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
 
 #include <lua.h>
 #include <lauxlib.h>
@@ -34,6 +38,9 @@
     uv_read_stop((uv_stream_t*)&self->handle);          \
     if (self->handle.fd >= 0) {                         \
       uv_shutdown_t* shutdown_req;                      \
+      if (self->wreq) { /* bottled or corked writes */  \
+        tcp_flush(self);                                \
+      }                                                 \
       shutdown_req = malloc(sizeof(uv_shutdown_t));     \
       shutdown_req->data = (uv_handle_t*)&self->handle; \
       uv_shutdown(                                      \
@@ -42,31 +49,88 @@
         ,tcp_after_shutdown                             \
       );                                                \
     } else {                                            \
+      if (self->wreq) { /* nowhere to send them */      \
+        tcp_drop_wreq(L, self);                         \
+      }                                                 \
       tcp_after_close((uv_handle_t*)&self->handle);     \
     }                                                   \
 
 
-#define BUFFER_MAX_CHUNKS 16 /* DO NOT CHANGE (1<<16) == 65536 */
+#define TCP_WRITE_CHUNKS 16       /* chunks a write request starts out with room for */
+#define TCP_WRITE_MAX_CHUNKS 1024 /* IOV_MAX on linux; a request this full is flushed */
 
+#define TCP_HIGH_WATER (64 * 1024) /* write() returns false from here on */
+#define TCP_LOW_WATER  (16 * 1024) /* on_drain fires once the queue is back under this */
+
+/*
+  nothing is copied on write: a string chunk stays pinned in the registry
+  and a buffer chunk holds a ref on its MemBlock until tcp_after_write.
+*/
+typedef struct {
+  int ref;      /* registry ref of a string chunk, else LUA_NOREF */
+  MemBlock *mb; /* block of a buffer chunk, else NULL */
+} write_pin_t;
+
+/* one uv_write worth of chunks; grows while bottled or corked */
 typedef struct {
   uv_write_t req;
-  uv_buf_t bufs[BUFFER_MAX_CHUNKS];
+  uv_buf_t *bufs;    /* our iovec, right after the struct */
+  write_pin_t *pins; /* right after bufs */
   int bufcnt;
-  int mask;
+  int bufcap;
+  size_t bytes; /* sum of bufs, for the write queue accounting */
 } write_req_t;
 
+/*
+  write backpressure. queued counts bytes from write() until libuv is
+  done with them, bottled ones included. once it reaches high_water,
+  write() returns false (the data is still taken) and the next time the
+  queue drains to low_water or below, on_drain is called.
+*/
 typedef struct {
+  size_t queued;
+  size_t peak;       /* largest queued seen */
+  size_t written;    /* bytes libuv finished writing */
+  size_t writes;     /* uv_write calls */
+  size_t drains;     /* on_drain calls */
+  size_t high_water;
+  size_t low_water;
+  int full;          /* write() returned false; on_drain is due */
+} tcp_wqueue_t;
+
+typedef struct _tcp_obj tcp_obj;
+
+struct _tcp_obj {
   LEVBASE_REF_FIELDS
   uv_tcp_t handle;
   uv_connect_t connect_req; /* TODO alloc on as needed basis */
   int bottle_mode; /* not yet decided on if we should move this to write_req_t */
   write_req_t *wreq;
-} tcp_obj;
+  lev_readsize_t readsize;
+  tcp_wqueue_t wq;
+  int autocork;        /* write() leaves the flush to tcp_on_prepare */
+  int corked;          /* on the tcp_corked list */
+  int cork_ref;        /* keeps us alive while on the list */
+  tcp_obj *cork_next;
+  size_t accepted;     /* listener: accept() calls that got a connection */
+  size_t accept_errors;
+  size_t accept_batches;
+  int accept_nodelay;   /* listener presets for the handles it accepts */
+  int accept_keepalive; /* keepalive delay in seconds; 0 is off */
+  int accept_batch;     /* listen{batch}: accept in C, this many per callback; 0 is off */
+  int batch_ref;        /* table of accepted handles not handed to Lua yet */
+  int batch_count;
+  int batch_listed;     /* on the tcp_accepting list */
+  tcp_obj *batch_next;
+};
+
+static void tcp_flush(tcp_obj* self);
+static void tcp_drop_wreq(lua_State* L, tcp_obj* self);
 
 static void tcp_after_close(uv_handle_t* handle) {
   UNWRAP(handle);
   lev_handle_unref(L, (LevRefStruct_t*)self);
-  if (push_callback(L, self, "on_close")) {
+  if (push_callback(L, self, LEV_CB_CLOSE)) {
     lua_call(L, 1, 0);/*, -3*/
   }
 }
@@ -81,7 +145,7 @@ void tcp_after_shutdown(uv_shutdown_t* req, int status) {
 
 static void on_connect(uv_connect_t* req, int status) {
   UNWRAP(req->handle);
-  push_callback(L, self, "on_connect");
+  push_callback(L, self, LEV_CB_CONNECT);
   if (!status) {
     lua_pushnil(L);
     /*printf("CONNECT ON FD: %d (ref:%d)\n", ( (uv_stream_t*)&self->handle )->fd, ((LevRefStruct_t*)self)->refCount);*/
@@ -93,9 +157,15 @@ static void on_connect(uv_connect_t* req, int status) {
 }
 
 
+static void tcp_accept_batched(lua_State* L, tcp_obj* self);
+
 static void on_connection(uv_stream_t* handle, int status) {
   UNWRAP(handle);
-  push_callback(L, self, "on_connection");
+  if (!status && self->accept_batch) {
+    tcp_accept_batched(L, self);
+    return;
+  }
+  push_callback(L, self, LEV_CB_CONNECTION);
   if (!status) {
     lua_pushnil(L);
   } else {
@@ -110,7 +180,7 @@ static void on_read(uv_stream_t* handle, ssize_t nread, uv_buf_t buf) {
     lev_pushbuffer_from_static_mb(L, nread); /* won't actually push -- used to clean-up! */
     UV_CLOSE_CLIENT
   } else {
-    push_callback(L, self, "on_read");
+    push_callback(L, self, LEV_CB_READ);
     lua_pushinteger(L, nread);
 
     lev_pushbuffer_from_static_mb(L, nread);
@@ -131,6 +201,8 @@ static int tcp_new(lua_State* L) {
 
   self = (tcp_obj*)create_obj_init_ref(L, sizeof *self, "lev.tcp");
   uv_tcp_init(loop, &self->handle);
+  self->wq.high_water = TCP_HIGH_WATER;
+  self->wq.low_water = TCP_LOW_WATER;
 
   if (use_this_fd) {
     self->handle.fd = use_this_fd;
@@ -140,28 +212,231 @@ static int tcp_new(lua_State* L) {
 }
 
 
-static int tcp_accept(lua_State* L) {
-  tcp_obj* self;
+/*
+  pushes a handle for the connection libuv has pending and returns 0, or
+  returns uv_accept's error with nothing pushed
+*/
+static int tcp_push_accepted(lua_State* L, tcp_obj* self) {
   tcp_obj* obj;
   int r;
 
-  self = luaL_checkudata(L, 1, "lev.tcp");
-
   obj = (tcp_obj*)create_obj_init_ref(L, sizeof *obj, "lev.tcp");
   uv_tcp_init(self->handle.loop, &obj->handle);
+  /* connections take the listener's water marks and cork mode */
+  obj->wq.high_water = self->wq.high_water;
+  obj->wq.low_water = self->wq.low_water;
+  obj->autocork = self->autocork;
 
   r = uv_accept((uv_stream_t*)&self->handle,
                 (uv_stream_t*)&obj->handle);
   if (!r) {
-    lua_pushnil(L);
-    lev_handle_ref(L, (LevRefStruct_t*)obj, 2);
+    lev_handle_ref(L, (LevRefStruct_t*)obj, lua_gettop(L));
+    self->accepted++;
+    if (self->accept_nodelay) {
+      uv_tcp_nodelay(&obj->handle, 1);
+    }
+    if (self->accept_keepalive) {
+      uv_tcp_keepalive(&obj->handle, 1, self->accept_keepalive);
+    }
     /*printf("ACCEPTED FD: %d\n", ( (uv_stream_t*)&obj->handle )->fd);*/
   } else {
+    self->accept_errors++;
+    /* the handle was initialised; close it, holding the object until tcp_after_close */
+    lev_handle_ref(L, (LevRefStruct_t*)obj, lua_gettop(L));
+    uv_close((uv_handle_t*)&obj->handle, tcp_after_close);
+    lua_pop(L, 1);
+  }
+  return r;
+}
+
+static int tcp_accept(lua_State* L) {
+  tcp_obj* self;
+  int r;
+
+  self = luaL_checkudata(L, 1, "lev.tcp");
+
+  r = tcp_push_accepted(L, self);
+  if (r) {
+    lua_pushnil(L);
     lua_pushinteger(L, r);
+    return 2;
   }
+  lua_pushnil(L);
   return 2;
 }
 
+/* X:S batched accept */
+
+/*
+  listen(cb, backlog, { batch = n }) accepts in C. every connection libuv
+  reports becomes a lev.tcp right away, with the listener's presets, and
+  joins a table that goes to cb(server, nil, clients) once it holds n
+  handles, or from a uv_check once the loop is done with this poll. an
+  accept storm then costs one Lua call per wakeup, not two per connection.
+*/
+static uv_check_t tcp_acceptor;
+static tcp_obj* tcp_accepting = NULL;
+
+/* nobody to hand the batch to: close what was accepted */
+static void tcp_close_batch(lua_State* L, int ref) {
+  tcp_obj* obj;
+  int i, n;
+
+  lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+  luaL_unref(L, LUA_REGISTRYINDEX, ref);
+  n = lua_objlen(L, -1);
+  for (i = 1; i <= n; i++) {
+    lua_rawgeti(L, -1, i);
+    obj = lua_touserdata(L, -1);
+    uv_close((uv_handle_t*)&obj->handle, tcp_after_close);
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+}
+
+static void tcp_dispatch_batch(lua_State* L, tcp_obj* self) {
+  int ref = self->batch_ref;
+
+  if (!self->batch_count) {
+    return;
+  }
+  self->batch_count = 0;
+  self->batch_ref = LUA_NOREF;
+  self->accept_batches++;
+  if (push_callback(L, self, LEV_CB_CONNECTION)) {
+    lua_pushnil(L);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, ref);
+    lua_call(L, 3, 0);
+  } else {
+    tcp_close_batch(L, ref);
+  }
+}
+
+/*
+  the listener is closing: take it off tcp_accepting and close the
+  connections it was still holding. the list holds a ref while a batch is
+  pending, so this is the only way out for a listener with one.
+*/
+static void tcp_drop_batch(lua_State* L, tcp_obj* self) {
+  tcp_obj** link;
+  int ref = self->batch_ref;
+
+  if (!self->batch_listed) {
+    return;
+  }
+  for (link = &tcp_accepting; *link != self; link = &(*link)->batch_next)
+    ;
+  *link = self->batch_next;
+  self->batch_next = NULL;
+  self->batch_listed = 0;
+  if (self->batch_count) {
+    self->batch_count = 0;
+    self->batch_ref = LUA_NOREF;
+    tcp_close_batch(L, ref);
+  }
+  lev_handle_unref(L, (LevRefStruct_t*)self);
+}
+
+static void tcp_on_check(uv_check_t* handle, int status) {
+  tcp_obj* self;
+
+  while (tcp_accepting) {
+    self = tcp_accepting;
+    tcp_accepting = self->batch_next;
+    self->batch_next = NULL;
+    self->batch_listed = 0;
+    tcp_dispatch_batch(self->_L, self);
+    lev_handle_unref(self->_L, (LevRefStruct_t*)self);
+  }
+  uv_check_stop(handle);
+}
+
+static void tcp_accept_batched(lua_State* L, tcp_obj* self) {
+  int r;
+
+  r = tcp_push_accepted(L, self);
+  if (r) {
+    if (push_callback(L, self, LEV_CB_CONNECTION)) {
+      lua_pushinteger(L, r);
+      lua_call(L, 2, 0);
+    }
+    return;
+  }
+
+  if (!self->batch_count) {
+    lua_createtable(L, self->accept_batch, 0);
+    self->batch_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  lua_rawgeti(L, LUA_REGISTRYINDEX, self->batch_ref);
+  lua_insert(L, -2);
+  lua_rawseti(L, -2, ++self->batch_count);
+  lua_pop(L, 1);
+
+  if (self->batch_count >= self->accept_batch) {
+    tcp_dispatch_batch(L, self);
+    return;
+  }
+  if (!self->batch_listed) { /* hold on to the listener until tcp_on_check */
+    if (!tcp_accepting) {
+      uv_check_start(&tcp_acceptor, tcp_on_check);
+    }
+    push_object(L, self);
+    lev_handle_ref(L, (LevRefStruct_t*)self, lua_gettop(L));
+    lua_pop(L, 1);
+    self->batch_listed = 1;
+    self->batch_next = tcp_accepting;
+    tcp_accepting = self;
+  }
+}
+
+/* X:E batched accept */
+
+/* accept_stats() -> { accepted = ..., errors = ..., batches = ... } */
+static int tcp_accept_stats(lua_State* L) {
+  tcp_obj* self = luaL_checkudata(L, 1, "lev.tcp");
+
+  lua_createtable(L, 0, 3);
+  LEV_SET_FIELD(accepted, number, self->accepted);
+  LEV_SET_FIELD(errors, number, self->accept_errors);
+  LEV_SET_FIELD(batches, number, self->accept_batches);
+  return 1;
+}
+
+/*
+  a socket of our own with SO_REUSEPORT set before bind, so every worker
+  can bind the same port and the kernel spreads connections over them.
+  uv_tcp_bind only creates a socket when there is none, and so takes
+  this one as it is. returns 0 or an errno.
+*/
+static int tcp_reuseport_socket(tcp_obj* self) {
+#ifdef SO_REUSEPORT
+  int fd;
+  int on = 1;
+
+  if (self->handle.fd >= 0) {
+    return EINVAL; /* already has a socket; too late for the option */
+  }
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return errno;
+  }
+  if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0
+   || fcntl(fd, F_SETFD, FD_CLOEXEC) < 0
+   || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on) < 0
+   || setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof on) < 0) {
+    int err = errno;
+    close(fd);
+    return err;
+  }
+  self->handle.fd = fd;
+  return 0;
+#else
+  (void)self;
+  return ENOPROTOOPT;
+#endif
+}
+
 
 static int tcp_bind(lua_State* L) {
   struct sockaddr_in addr;
@@ -174,6 +449,14 @@ static int tcp_bind(lua_State* L) {
   host = luaL_checkstring(L, 2);
   port = luaL_checkint(L, 3);
 
+  if (lua_toboolean(L, 4)) { /* bind(host, port, reuseport) */
+    r = tcp_reuseport_socket(self);
+    if (r) {
+      lua_pushinteger(L, r);
+      return 1;
+    }
+  }
+
   addr = uv_ip4_addr(host, port);
 
   r = uv_tcp_bind(&self->handle, addr);
@@ -198,7 +481,7 @@ static int tcp_connect(lua_State* L) {
   self = luaL_checkudata(L, 1, "lev.tcp");
   host = luaL_checkstring(L, 2);
   port = luaL_checkint(L, 3);
-  set_callback(L, "on_connect", 4);
+  set_callback(L, LEV_CB_CONNECT, 4);
 
   addr = uv_ip4_addr(host, port);
 
@@ -221,8 +504,9 @@ static int tcp_close(lua_State* L) {
   self = luaL_checkudata(L, 1, "lev.tcp");
 
   if (lua_isfunction(L, 2))
-    set_callback(L, "on_close", 2);
+    set_callback(L, LEV_CB_CLOSE, 2);
 
+  tcp_drop_batch(L, self);
   UV_CLOSE_CLIENT
 
   return 0;
@@ -254,13 +538,26 @@ static int tcp_listen(lua_State* L) {
 
   self = luaL_checkudata(L, 1, "lev.tcp");
 
-  set_callback(L, "on_connection", 2);
+  set_callback(L, LEV_CB_CONNECTION, 2);
 
   backlog = lua_tointeger(L, 3);
   if (!backlog) {
     backlog = 128;
   }
 
+  if (lua_istable(L, 4)) { /* { batch = n, nodelay = true, keepalive = seconds } */
+    lua_getfield(L, 4, "batch");
+    lua_getfield(L, 4, "nodelay");
+    lua_getfield(L, 4, "keepalive");
+    if (lua_tointeger(L, -3) < 0 || lua_tointeger(L, -1) < 0) {
+      return luaL_argerror(L, 4, "batch and keepalive must not be negative");
+    }
+    self->accept_batch = lua_tointeger(L, -3);
+    self->accept_nodelay = lua_toboolean(L, -2);
+    self->accept_keepalive = lua_tointeger(L, -1);
+    lua_pop(L, 3);
+  }
+
   r = uv_listen((uv_stream_t*)&self->handle, backlog, on_connection);
   if (!r) {
     lua_pushnil(L);
@@ -274,7 +571,7 @@ static int tcp_listen(lua_State* L) {
 
 static int tcp_rcb_close(lua_State* L) {
   luaL_checkudata(L, 1, "lev.tcp"); /* we won't use the data, but check if it is actually lev.tcp*/
-  set_callback(L, "on_close", 2);
+  set_callback(L, LEV_CB_CLOSE, 2);
   return 0;
 }
 
@@ -283,10 +580,11 @@ static int tcp_read_start(lua_State* L) {
   int r;
 
   self = luaL_checkudata(L, 1, "lev.tcp");
-  set_callback(L, "on_read", 2);
+  set_callback(L, LEV_CB_READ, 2);
 
   /*printf("STARTING READ ON FD %d (ref:%d)\n", ( (uv_stream_t*)&self->handle )->fd, ((LevRefStruct_t*)self)->refCount);*/
 
+  lev_readsize_start((uv_handle_t*)&self->handle, &self->readsize);
   r = uv_read_start((uv_stream_t*)&self->handle, on_alloc, on_read);
   if (!r) {
     lua_pushnil(L);
@@ -314,7 +612,7 @@ static int tcp_read_stop(lua_State* L) {
   }
 
   if (r == 0) {
-    clear_callback(L, "on_read", self);
+    clear_callback(L, LEV_CB_READ, self);
   }
   
   /*lev_handle_unref(L, (LevRefStruct_t*)self);*/
@@ -322,65 +620,358 @@ static int tcp_read_stop(lua_State* L) {
   return 1;
 }
 
+/* read_stats() -> { size = ..., reads = ..., bytes = ..., grows = ..., shrinks = ... } */
+static int tcp_read_stats(lua_State* L) {
+  tcp_obj* self = luaL_checkudata(L, 1, "lev.tcp");
+
+  lev_readsize_push(L, &self->readsize);
+  return 1;
+}
+
+/* bytes left libuv's hands: maybe time for on_drain */
+static void tcp_written(lua_State* L, tcp_obj* self, size_t bytes, int status) {
+  self->wq.queued -= bytes;
+  if (!status) {
+    self->wq.written += bytes;
+  }
+  if (self->wq.full && self->wq.queued <= self->wq.low_water) {
+    self->wq.full = 0;
+    if (!status && push_callback(L, self, LEV_CB_DRAIN)) {
+      self->wq.drains++;
+      lua_call(L, 1, 0);
+    }
+  }
+}
+
+/* account for bytes handed to write(); returns what write() should say */
+static int tcp_queued(tcp_obj* self, size_t bytes) {
+  self->wq.queued += bytes;
+  if (self->wq.queued > self->wq.peak) {
+    self->wq.peak = self->wq.queued;
+  }
+  if (self->wq.queued >= self->wq.high_water) {
+    self->wq.full = 1;
+  }
+  return !self->wq.full;
+}
+
+/* lets go of the chunks a write request pinned, then of the request */
+static void tcp_wreq_free(lua_State* L, write_req_t* wr) {
+  int i;
+
+  for (i = 0; i < wr->bufcnt; i++) {
+    if (wr->pins[i].mb) {
+      lev_slab_decRef(wr->pins[i].mb);
+    } else {
+      luaL_unref(L, LUA_REGISTRYINDEX, wr->pins[i].ref);
+    }
+  }
+  free(wr);
+}
+
 void tcp_after_write(uv_write_t* req, int status) {
-  /*UNWRAP(req->handle);*/
+  UNWRAP(req->handle);
   write_req_t* wr;
   /*lev_handle_unref(L, (LevRefStruct_t*)self);*/
 
   wr = (write_req_t*)req;
-  do {
-    if (wr->mask & (1<<wr->bufcnt)) {/* we malloc'd this earlier (as opposed to a cBuffer) */
-      /*printf("[tcp_after_write] FREEING <%d>\n", wr->bufcnt);*/
-      free( wr->bufs[ wr->bufcnt ].base );
-    }
-  } while (wr->bufcnt--);
+  tcp_written(L, self, wr->bytes, status);
+  tcp_wreq_free(L, wr);
+}
+
+/* bottled or corked writes that will never be sent: unqueue and release them */
+static void tcp_drop_wreq(lua_State* L, tcp_obj* self) {
+  write_req_t* wr = self->wreq;
+
+  self->wreq = NULL;
+  tcp_written(L, self, wr->bytes, -1); /* failed: no on_drain */
+  tcp_wreq_free(L, wr);
+}
+
+static write_req_t* tcp_wreq_new(int cap) {
+  write_req_t* wr;
+
+  wr = malloc(sizeof(write_req_t) + cap * (sizeof(uv_buf_t) + sizeof(write_pin_t)));
+  wr->bufs = (uv_buf_t*)(wr + 1);
+  wr->pins = (write_pin_t*)(wr->bufs + cap);
+  wr->bufcnt = 0;
+  wr->bufcap = cap;
+  wr->bytes = 0;
+  return wr;
+}
+
+/* self->wreq with room for one more chunk; it is not submitted yet, so it can move */
+static write_req_t* tcp_wreq_reserve(tcp_obj* self) {
+  write_req_t* wr = self->wreq;
+  write_req_t* grown;
+
+  if (!wr) {
+    self->wreq = tcp_wreq_new(TCP_WRITE_CHUNKS);
+    return self->wreq;
+  }
+  if (wr->bufcnt < wr->bufcap) {
+    return wr;
+  }
+  grown = tcp_wreq_new(wr->bufcap * 2);
+  memcpy(grown->bufs, wr->bufs, wr->bufcnt * sizeof(uv_buf_t));
+  memcpy(grown->pins, wr->pins, wr->bufcnt * sizeof(write_pin_t));
+  grown->bufcnt = wr->bufcnt;
+  grown->bytes = wr->bytes;
   free(wr);
+  self->wreq = grown;
+  return grown;
+}
+
+
+static void tcp_flush(tcp_obj* self) {
+  if (!self->wreq) {
+    return;
+  }
+  uv_write(
+     (uv_write_t*) &self->wreq->req
+    ,(uv_stream_t*)&self->handle 
+    ,self->wreq->bufs /* our iovec */
+    ,self->wreq->bufcnt /* iovcnt */
+    ,tcp_after_write /* callback */
+  );
+  /*lev_handle_ref(L, (LevRefStruct_t*)self, 1);*/
+  /* once we flush, we remove the object but do not free it (it will be free'd later on callback! */
+  self->wreq = NULL;
+  self->wq.writes++;
+}
+
+static size_t tcp_writev_bytes(lev_writev_t* w) {
+  size_t bytes = 0;
+  int i;
+
+  for (i = 0; i < w->bufcnt; i++) {
+    bytes += w->bufs[i].len;
+  }
+  return bytes;
+}
+
+static void tcp_after_writev(uv_write_t* req, int status) {
+  UNWRAP(req->handle);
+  lev_writev_t* w = (lev_writev_t*)req;
+
+  tcp_written(L, self, tcp_writev_bytes(w), status);
+  lev_writev_done(w);
+}
+
+/* a bufferlist goes out as one iovec, after anything already bottled */
+static int tcp_writev(lua_State* L, tcp_obj* self, lev_bufferlist_t* bl) {
+  lev_writev_t* w;
+
+  if (self->wreq && self->wreq->bufcnt) {
+    tcp_flush(self);
+  }
+
+  w = lev_bufferlist_writev(L, bl);
+  if (!w->bufcnt) {
+    lev_writev_done(w);
+    lua_pushboolean(L, !self->wq.full);
+    return 1;
+  }
+  lua_pushboolean(L, tcp_queued(self, tcp_writev_bytes(w)));
+  uv_write(&w->req, (uv_stream_t*)&self->handle, w->bufs, w->bufcnt, tcp_after_writev);
+  self->wq.writes++;
+  return 1;
+}
+
+/* X:S autocork */
+
+/*
+  with autocork on, write() only gathers chunks; every handle written to
+  during a loop iteration is flushed once, as one writev, from a
+  uv_prepare right before the loop polls again.
+*/
+static uv_prepare_t tcp_corker;
+static tcp_obj* tcp_corked = NULL;
+
+static void tcp_on_prepare(uv_prepare_t* handle, int status) {
+  tcp_obj* self;
+
+  while (tcp_corked) {
+    self = tcp_corked;
+    tcp_corked = self->cork_next;
+    self->cork_next = NULL;
+    self->corked = 0;
+    if (!self->bottle_mode) {
+      tcp_flush(self);
+    }
+    luaL_unref(self->_L, LUA_REGISTRYINDEX, self->cork_ref);
+  }
+  uv_prepare_stop(handle);
+}
+
+/* self is at index 1 */
+static void tcp_cork(lua_State* L, tcp_obj* self) {
+  if (self->corked) {
+    return;
+  }
+  if (!tcp_corked) {
+    uv_prepare_start(&tcp_corker, tcp_on_prepare);
+  }
+  lua_pushvalue(L, 1);
+  self->cork_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  self->corked = 1;
+  self->cork_next = tcp_corked;
+  tcp_corked = self;
 }
 
+/* X:E autocork */
+
+static int tcp_is_buffer(lua_State* L, int index) {
+  int r = 0;
+
+  if (lua_touserdata(L, index) && lua_getmetatable(L, index)) {
+    luaL_getmetatable(L, "lev.buffer");
+    r = lua_rawequal(L, -1, -2);
+    lua_pop(L, 2);
+  }
+  return r;
+}
+
+/* add the string or buffer at index to self->wreq; returns its length */
+static size_t tcp_push_chunk(lua_State* L, tcp_obj* self, int index) {
+  write_req_t* wr;
+  write_pin_t* pin;
+  MemSlice* ms;
+  const char* chunk;
+  size_t len;
+
+  if (lua_isstring(L, index)) {
+    /* the string stays put while referenced, so libuv can write from it */
+    chunk = lua_tolstring(L, index, &len);
+    wr = tcp_wreq_reserve(self);
+    pin = &wr->pins[ wr->bufcnt ];
+    lua_pushvalue(L, index);
+    pin->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    pin->mb = NULL;
+  } else {
+    ms = lev_checkbuffer(L, index);
+    chunk = (const char*)ms->slice;
+    len = ms->until;
+    wr = tcp_wreq_reserve(self);
+    pin = &wr->pins[ wr->bufcnt ];
+    lev_slab_incRef(ms->mb);
+    pin->ref = LUA_NOREF;
+    pin->mb = ms->mb;
+  }
+  wr->bufs[ wr->bufcnt++ ] = uv_buf_init((char*)chunk, len);
+  wr->bytes += len;
+
+  if (wr->bufcnt == TCP_WRITE_MAX_CHUNKS) {
+    tcp_flush(self);
+  }
+  return len;
+}
+
+/* write({ chunk, ... }): all of them in one request */
+static size_t tcp_push_table(lua_State* L, tcp_obj* self, int index) {
+  size_t len = 0;
+  int n = lua_objlen(L, index);
+  int i;
+
+  for (i = 1; i <= n; i++) { /* check first, so a bad chunk writes nothing */
+    lua_rawgeti(L, index, i);
+    if (!lua_isstring(L, -1) && !tcp_is_buffer(L, -1)) {
+      luaL_argerror(L, index, "table of strings and buffers expected");
+    }
+    lua_pop(L, 1);
+  }
+  for (i = 1; i <= n; i++) {
+    lua_rawgeti(L, index, i);
+    len += tcp_push_chunk(L, self, lua_gettop(L));
+    lua_pop(L, 1);
+  }
+  return len;
+}
 
 static int tcp_write(lua_State* L) {
   tcp_obj* self;
-  char* tmp;
+  lev_bufferlist_t* bl;
   size_t len;
 
   self = luaL_checkudata(L, 1, "lev.tcp");
 
-  if (!self->wreq) {
-    self->wreq = malloc(sizeof(write_req_t));
-    memset(self->wreq, 0, sizeof(write_req_t));
+  bl = lev_tobufferlist(L, 2);
+  if (bl) {
+    return tcp_writev(L, self, bl);
   }
 
-  if (lua_isstring(L, 2)) {
-    const char* chunk = luaL_checklstring(L, 2, &len);
-    self->wreq->mask |= (1<<self->wreq->bufcnt); /* mark this position as malloc'd */
-    tmp = malloc(len); /* X:TODO in the future, perhaps we can replace this with a cBuffer! */
-    memcpy(tmp, (char*)chunk, len);
-    /*printf("[WRITE] MALLOCING <%d>\n", self->wreq->bufcnt);*/
-    self->wreq->bufs[ self->wreq->bufcnt++ ] = uv_buf_init(tmp, len);
+  if (lua_istable(L, 2)) {
+    len = tcp_push_table(L, self, 2);
   } else {
-    self->wreq->mask &= ~(1<<self->wreq->bufcnt); /* mark this position as cBuffer */
-    self->wreq->bufs[ self->wreq->bufcnt++ ] = lev_buffer_to_uv(L, 2);
+    len = tcp_push_chunk(L, self, 2);
   }
+  lua_pushboolean(L, tcp_queued(self, len));
 
   if (LUA_TNUMBER == lua_type(L, 3)) { /* unbottle and flush */
     self->bottle_mode = 0;
+    tcp_flush(self);
+  } else if (!self->bottle_mode) {
+    if (self->autocork) {
+      tcp_cork(L, self);
+    } else {
+      tcp_flush(self);
+    }
   }
+  return 1;
+}
 
-  if (!self->bottle_mode || self->wreq->bufcnt == BUFFER_MAX_CHUNKS) { /* FLUSH */
-    uv_write(
-       (uv_write_t*) &self->wreq->req
-      ,(uv_stream_t*)&self->handle 
-      ,self->wreq->bufs /* our iovec */
-      ,self->wreq->bufcnt /* iovcnt */
-      ,tcp_after_write /* callback */
-    );
-    /*lev_handle_ref(L, (LevRefStruct_t*)self, 1);*/
-    /* once we flush, we remove the object but do not free it (it will be free'd later on callback! */
-    self->wreq = NULL;
-  }
+/* on_drain(callback) -- called once the queue is back under the low-water mark */
+static int tcp_rcb_drain(lua_State* L) {
+  luaL_checkudata(L, 1, "lev.tcp");
+  set_callback(L, LEV_CB_DRAIN, 2);
   return 0;
 }
 
+/* water_marks([high, low]) -> high, low; low defaults to a quarter of high */
+static int tcp_water_marks(lua_State* L) {
+  tcp_obj* self = luaL_checkudata(L, 1, "lev.tcp");
+
+  if (!lua_isnoneornil(L, 2)) {
+    lua_Integer high = luaL_checkinteger(L, 2);
+    lua_Integer low = luaL_optinteger(L, 3, high / 4);
+    if (high < 1) {
+      return luaL_argerror(L, 2, "must be positive");
+    }
+    if (low < 0 || low >= high) {
+      return luaL_argerror(L, 3, "must be below the high-water mark");
+    }
+    self->wq.high_water = (size_t)high;
+    self->wq.low_water = (size_t)low;
+    if (self->wq.queued >= self->wq.high_water) {
+      self->wq.full = 1;
+    }
+  }
+  lua_pushnumber(L, self->wq.high_water);
+  lua_pushnumber(L, self->wq.low_water);
+  return 2;
+}
+
+/* write_queue_size() -> bytes written but not yet taken by the kernel */
+static int tcp_write_queue_size(lua_State* L) {
+  tcp_obj* self = luaL_checkudata(L, 1, "lev.tcp");
+
+  lua_pushnumber(L, self->wq.queued);
+  return 1;
+}
+
+/* write_stats() -> { queued = ..., peak = ..., written = ..., writes = ..., drains = ... } */
+static int tcp_write_stats(lua_State* L) {
+  tcp_obj* self = luaL_checkudata(L, 1, "lev.tcp");
+
+  lua_createtable(L, 0, 5);
+  LEV_SET_FIELD(queued, number, self->wq.queued);
+  LEV_SET_FIELD(peak, number, self->wq.peak);
+  LEV_SET_FIELD(written, number, self->wq.written);
+  LEV_SET_FIELD(writes, number, self->wq.writes);
+  LEV_SET_FIELD(drains, number, self->wq.drains);
+  return 1;
+}
+
 static int tcp_nodelay(lua_State* L) {
   tcp_obj* self;
 
@@ -400,6 +991,19 @@ static int tcp_bottle(lua_State* L) {
   return 0;
 }
 
+/* autocork([on]) -> on */
+static int tcp_autocork(lua_State* L) {
+  tcp_obj* self;
+
+  self = luaL_checkudata(L, 1, "lev.tcp");
+  if (!lua_isnoneornil(L, 2)) {
+    self->autocork = lua_toboolean(L, 2);
+  }
+  lua_pushboolean(L, self->autocork);
+
+  return 1;
+}
+
 static int tcp_is_bottled(lua_State* L) {
   tcp_obj* self;
 
@@ -415,10 +1019,16 @@ static luaL_reg methods[] = {
   ,{ "connect",    tcp_connect        } /* ref(self)   */
   ,{ "close",      tcp_close          } /* unref(self) */
   ,{ "listen",     tcp_listen         } /* ref(self)   */
+  ,{ "accept_stats", tcp_accept_stats }
   ,{ "on_close",   tcp_rcb_close      }
   ,{ "read_start", tcp_read_start     }
   ,{ "read_stop",  tcp_read_stop      }
+  ,{ "read_stats", tcp_read_stats     }
   ,{ "write",      tcp_write          }
+  ,{ "on_drain",   tcp_rcb_drain      }
+  ,{ "water_marks", tcp_water_marks   }
+  ,{ "write_queue_size", tcp_write_queue_size }
+  ,{ "write_stats", tcp_write_stats   }
   ,{ "fd_get",     tcp_fd_get         }
   ,{ "fd_set",     tcp_fd_set         }
   ,{ "nodelay",    tcp_nodelay        }
@@ -426,6 +1036,7 @@ static luaL_reg methods[] = {
   /* used to help transmission */   
   ,{ "bottle",     tcp_bottle         }
   ,{ "isBottled",  tcp_is_bottled     }
+  ,{ "autocork",   tcp_autocork       }
 
   ,{ NULL,         NULL               }
 };
@@ -446,4 +1057,7 @@ void luaopen_lev_tcp(lua_State *L) {
   lua_createtable(L, 0, ARRAY_SIZE(functions) - 1);
   luaL_register(L, NULL, functions);
   lua_setfield(L, -2, "tcp");
+
+  uv_prepare_init(lev_get_loop(L), &tcp_corker);
+  uv_check_init(lev_get_loop(L), &tcp_acceptor);
 }
@@ -58,7 +58,7 @@ static int timer_new(lua_State* L) {
 
 static void timer_on_close(uv_handle_t *handle) {
   UNWRAP(handle);
-  if (push_callback(L, self, "on_close")) {
+  if (push_callback(L, self, LEV_CB_CLOSE)) {
     lua_call(L, 1, 0);/*, -3*/
     
   }
@@ -73,7 +73,7 @@ static int timer_close(lua_State* L) {
   self = luaL_checkudata(L, 1, "lev.timer");
 
   if (lua_isfunction(L, 2))
-    set_callback(L, "on_close", 2);
+    set_callback(L, LEV_CB_CLOSE, 2);
 
   handle = &self->handle;
   r = uv_timer_stop(handle);
@@ -86,7 +86,7 @@ static int timer_close(lua_State* L) {
 
 static void on_timer(uv_timer_t *handle, int status) {
   UNWRAP(handle);
-  push_callback(L, self, "on_timer");
+  push_callback(L, self, LEV_CB_TIMER);
   lua_pushinteger(L, status);
   lua_call(L, 2, 0);/*, -4*/
 }
@@ -98,7 +98,7 @@ static int timer_start(lua_State* L) {
   int r;
 
   self = luaL_checkudata(L, 1, "lev.timer");
-  set_callback(L, "on_timer", 2);
+  set_callback(L, LEV_CB_TIMER, 2);
   timeout = luaL_optlong(L, 3, 0);
   repeat = luaL_optlong(L, 4, 0);
 
@@ -153,7 +153,7 @@ static int udp_send(lua_State* L) {
 
 static void udp_after_close(uv_handle_t* handle) {
   UNWRAP(handle);
-  if (push_callback(L, self, "on_close")) {
+  if (push_callback(L, self, LEV_CB_CLOSE)) {
     lua_call(L, 1, 0);/*, -3*/
     
   }
@@ -187,7 +187,7 @@ static void on_recv(uv_udp_t* handle, ssize_t nread, uv_buf_t buf,
     UV_UDP_CLOSE(handle);
 
     if (nread == -1) {
-      push_callback(L, self, "on_recv");
+      push_callback(L, self, LEV_CB_RECV);
       lev_push_uv_errname(L, LEV_UV_ERRCODE_IN_LOOP(L));
       lua_call(L, 2, 0);
     }
@@ -203,7 +203,7 @@ static void on_recv(uv_udp_t* handle, ssize_t nread, uv_buf_t buf,
   r = uv_udp_recv_stop(handle);
   assert(r == 0);
 
-  push_callback(L, self, "on_recv");
+  push_callback(L, self, LEV_CB_RECV);
 
   lua_pushnil(L);
   push_sockaddr(L, addr);
@@ -219,7 +219,7 @@ static int udp_recv_start(lua_State* L) {
   int r;
 
   self = luaL_checkudata(L, 1, "lev.udp");
-  set_callback(L, "on_recv", 2);
+  set_callback(L, LEV_CB_RECV, 2);
 
   r = uv_udp_recv_start(&self->handle, on_alloc, on_recv);
   if (r == -1) {
@@ -239,7 +239,7 @@ static int udp_close(lua_State* L) {
   self = luaL_checkudata(L, 1, "lev.udp");
 
   if (lua_isfunction(L, 2))
-    set_callback(L, "on_close", 2);
+    set_callback(L, LEV_CB_CLOSE, 2);
 
   UV_UDP_CLOSE(&self->handle);
 
@@ -248,7 +248,7 @@ static int udp_close(lua_State* L) {
 
 static int udp_rcb_close(lua_State* L) {
   luaL_checkudata(L, 1, "lev.udp"); /* we won't use the data, but check if it is actually lev.udp*/
-  set_callback(L, "on_close", 2);
+  set_callback(L, LEV_CB_CLOSE, 2);
   return 0;
 }
 
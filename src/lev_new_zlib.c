@@ -0,0 +1,423 @@
+/*
+ *  Copyright 2012 connectFree k.k. and the lev authors. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#include "lev_new_base.h"
+
+#include <string.h>
+#include <zlib.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+#include "luv_debug.h"
+
+/*
+
+  lev.zlib -- streaming deflate/inflate from lev.buffers to lev.buffers.
+
+  Output is written straight into a slab block the stream holds on to;
+  every write() hands out the bytes it produced as a slice of that block
+  and the next write() carries on behind it, so small messages share one
+  block and nothing passes through a Lua string. When a write() runs out
+  of room its output so far moves to a block twice the size.
+
+*/
+
+#define ZLIB_BLOCK_SIZE (16 * 1024) /* first output block of a stream */
+#define ZLIB_MAX_IN     ((size_t)1 << 30) /* zlib counts input in uInt */
+
+typedef struct _lev_zlib {
+  z_stream strm;
+  int inflate;  /* an inflate stream, else deflate */
+  int ready;    /* initialized and not closed */
+  int ended;    /* Z_STREAM_END seen; reset() to go again */
+  MemBlock *mb; /* output block, shared with the buffers handed out */
+  size_t used;  /* bytes of mb handed out or being written */
+} lev_zlib_t;
+
+#define ZLIB_UDATA(L)                                                          \
+  lev_zlib_t *z = luaL_checkudata(L, 1, "lev.zlib");                           \
+  if (!z->ready) {                                                             \
+    return luaL_error(L, "zlib stream is closed");                             \
+  }
+
+static const char *format_names[] = { "deflate", "gzip", "raw", "auto", NULL };
+static const int format_bits[] = { 0, 16, -1, 32 }; /* added to windowBits; raw negates */
+
+static const char *flush_names[] = { "none", "sync", "full", "finish", NULL };
+static const int flush_modes[] = { Z_NO_FLUSH, Z_SYNC_FLUSH, Z_FULL_FLUSH, Z_FINISH };
+
+static const char *strategy_names[] = { "default", "filtered", "huffman", "rle", "fixed", NULL };
+static const int strategies[] = { Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED };
+
+static void _zlib_release(lev_zlib_t *z) {
+  if (z->mb) {
+    lev_slab_decRef(z->mb);
+  }
+  z->mb = NULL;
+  z->used = 0;
+}
+
+/*
+  room behind *start for more output: a fresh block, or one twice the
+  size of what the current write() produced so far, which moves along.
+*/
+static int _zlib_grow(lev_zlib_t *z, size_t *start) {
+  size_t pending = z->used - *start;
+  size_t size = pending * 2 > ZLIB_BLOCK_SIZE ? pending * 2 : ZLIB_BLOCK_SIZE;
+  MemBlock *mb = lev_slab_getBlock(size);
+
+  if (!mb) {
+    return -1;
+  }
+  lev_slab_incRef(mb);
+  mb->nbytes = mb->size;
+  if (z->mb) {
+    memcpy(mb->bytes, z->mb->bytes + *start, pending);
+    lev_slab_decRef(z->mb);
+  }
+  z->mb = mb;
+  z->used = pending;
+  *start = 0;
+  return 0;
+}
+
+/* hand out what the last write() produced, and drop the block once it is full */
+static void _zlib_push_output(lua_State *L, lev_zlib_t *z, size_t start) {
+  MemSlice *ms;
+
+  if (z->used == start) {
+    ms = lev_buffer_new(L, 0, NULL, 0);
+    lev_buffer_set_length(ms, 0);
+    return;
+  }
+  lev_pushbuffer_from_mb(L, z->mb, z->used - start, z->mb->bytes + start);
+  if (z->used == z->mb->size) {
+    _zlib_release(z);
+  }
+}
+
+/*
+  feed len bytes through the stream with the given flush mode. returns
+  Z_OK or Z_STREAM_END with the output on the stack, or a zlib error
+  code with nothing pushed.
+*/
+static int _zlib_run(lua_State *L, lev_zlib_t *z, const unsigned char *src, size_t len, int flush) {
+  size_t start = z->used;
+  size_t chunk, avail;
+  int rc = Z_OK;
+
+  if (!z->mb || z->used == z->mb->size) {
+    if (_zlib_grow(z, &start)) {
+      return Z_MEM_ERROR;
+    }
+  }
+
+  do {
+    chunk = len < ZLIB_MAX_IN ? len : ZLIB_MAX_IN;
+    z->strm.next_in = (Bytef *)src;
+    z->strm.avail_in = (uInt)chunk;
+    src += chunk;
+    len -= chunk;
+
+    for (;;) {
+      if (z->used == z->mb->size && _zlib_grow(z, &start)) {
+        return Z_MEM_ERROR;
+      }
+      avail = z->mb->size - z->used;
+      if (avail > ZLIB_MAX_IN) {
+        avail = ZLIB_MAX_IN;
+      }
+      z->strm.next_out = z->mb->bytes + z->used;
+      z->strm.avail_out = (uInt)avail;
+
+      if (z->inflate) {
+        rc = inflate(&z->strm, len ? Z_NO_FLUSH : flush);
+      } else {
+        rc = deflate(&z->strm, len ? Z_NO_FLUSH : flush);
+      }
+      z->used += avail - z->strm.avail_out;
+
+      if (rc == Z_STREAM_END) {
+        z->ended = 1;
+        len = 0; /* anything after the end of the stream is dropped */
+        break;
+      }
+      if (rc == Z_BUF_ERROR) {
+        if (!z->strm.avail_out) {
+          continue; /* Z_FINISH says this when it only ran out of room */
+        }
+        rc = Z_OK; /* no progress possible: more input is needed */
+        break;
+      }
+      if (rc != Z_OK) {
+        z->used = start; /* the partial output goes nowhere */
+        return rc;
+      }
+      if (z->strm.avail_out) {
+        break;
+      }
+    }
+  } while (len);
+
+  _zlib_push_output(L, z, start);
+  return rc;
+}
+
+/* push the write()/finish() results: buffer, ended -- or nil, message */
+static int _zlib_results(lua_State *L, lev_zlib_t *z, int rc) {
+  switch (rc) {
+    case Z_OK:
+    case Z_STREAM_END:
+      lua_pushboolean(L, z->ended);
+      return 2;
+    case Z_MEM_ERROR:
+      return luaL_error(L, "zlib: out of memory");
+    case Z_STREAM_ERROR:
+      return luaL_error(L, "zlib: inconsistent stream state");
+  }
+  lua_pushnil(L);
+  lua_pushstring(L, z->strm.msg ? z->strm.msg : (rc == Z_NEED_DICT ? "need dictionary" : "invalid data"));
+  return 2;
+}
+
+static lev_zlib_t *_zlib_new(lua_State *L, int inflate) {
+  lev_zlib_t *z = (lev_zlib_t *)lua_newuserdata(L, sizeof *z);
+
+  memset(z, 0, sizeof *z);
+  z->inflate = inflate;
+  luaL_getmetatable(L, "lev.zlib");
+  lua_setmetatable(L, -2);
+  return z;
+}
+
+static int _zlib_option(lua_State *L, int options, const char *name, int def) {
+  int value;
+
+  lua_getfield(L, options, name);
+  value = lua_isnil(L, -1) ? def : (int)luaL_checkinteger(L, -1);
+  lua_pop(L, 1);
+  return value;
+}
+
+static int _zlib_choice(lua_State *L, int options, const char *name, const char *def, const char *const list[]) {
+  int value;
+
+  lua_getfield(L, options, name);
+  value = luaL_checkoption(L, -1, def, list);
+  lua_pop(L, 1);
+  return value;
+}
+
+/* options table at index, or an empty one */
+static int _zlib_options(lua_State *L, int index) {
+  lua_settop(L, index);
+  if (lua_isnil(L, index)) {
+    lua_newtable(L);
+    lua_replace(L, index);
+  }
+  luaL_checktype(L, index, LUA_TTABLE);
+  return index;
+}
+
+/*
+  deflate({ format = "deflate" | "gzip" | "raw", level = -1..9,
+            windowBits = 9..15, memLevel = 1..9,
+            strategy = "default" | "filtered" | "huffman" | "rle" | "fixed" }) -> stream
+*/
+static int zlib_deflate(lua_State *L) {
+  int options = _zlib_options(L, 1);
+  int format = _zlib_choice(L, options, "format", "deflate", format_names);
+  int level = _zlib_option(L, options, "level", Z_DEFAULT_COMPRESSION);
+  int bits = _zlib_option(L, options, "windowBits", MAX_WBITS);
+  int mem = _zlib_option(L, options, "memLevel", 8);
+  int strategy = strategies[_zlib_choice(L, options, "strategy", "default", strategy_names)];
+  lev_zlib_t *z;
+
+  if (format_bits[format] == 32) {
+    return luaL_argerror(L, 1, "\"auto\" is for inflate only");
+  }
+  bits = format_bits[format] < 0 ? -bits : bits + format_bits[format];
+
+  z = _zlib_new(L, 0);
+  if (deflateInit2(&z->strm, level, Z_DEFLATED, bits, mem, strategy) != Z_OK) {
+    return luaL_argerror(L, 1, z->strm.msg ? z->strm.msg : "invalid deflate options");
+  }
+  z->ready = 1;
+  return 1;
+}
+
+/* inflate({ format = "deflate" | "gzip" | "raw" | "auto", windowBits = 8..15 }) -> stream */
+static int zlib_inflate(lua_State *L) {
+  int options = _zlib_options(L, 1);
+  int format = _zlib_choice(L, options, "format", "auto", format_names);
+  int bits = _zlib_option(L, options, "windowBits", MAX_WBITS);
+  lev_zlib_t *z;
+
+  bits = format_bits[format] < 0 ? -bits : bits + format_bits[format];
+
+  z = _zlib_new(L, 1);
+  if (inflateInit2(&z->strm, bits) != Z_OK) {
+    return luaL_argerror(L, 1, z->strm.msg ? z->strm.msg : "invalid inflate options");
+  }
+  z->ready = 1;
+  return 1;
+}
+
+/* the bytes of the buffer or string at index; none when it is absent */
+static const unsigned char *_zlib_input(lua_State *L, int index, size_t *len) {
+  if (lua_isnoneornil(L, index)) {
+    *len = 0;
+    return (const unsigned char *)"";
+  }
+  if (LUA_TSTRING == lua_type(L, index)) {
+    return (const unsigned char *)lua_tolstring(L, index, len);
+  }
+  MemSlice *ms = lev_checkbuffer(L, index);
+  *len = ms->until;
+  return ms->slice;
+}
+
+/*
+  write(stream, data, flush) -> buffer, ended | nil, message
+  data is a buffer or string, flush "none" (default), "sync", "full" or
+  "finish". buffer holds the output this produced, possibly nothing.
+*/
+static int zlib_write(lua_State *L) {
+  ZLIB_UDATA(L)
+  size_t len;
+  const unsigned char *src = _zlib_input(L, 2, &len);
+  int flush = flush_modes[luaL_checkoption(L, 3, "none", flush_names)];
+
+  if (z->ended) {
+    if (z->inflate) { /* trailing input after the end of the stream is dropped */
+      _zlib_push_output(L, z, z->used);
+      lua_pushboolean(L, 1);
+      return 2;
+    }
+    return luaL_error(L, "zlib: write after finish");
+  }
+  return _zlib_results(L, z, _zlib_run(L, z, src, len, flush));
+}
+
+/*
+  finish(stream, [data]) -> buffer, ended | nil, message
+  write(data, "finish"): deflate writes the trailer, inflate reports a
+  stream that has not ended yet as truncated.
+*/
+static int zlib_finish(lua_State *L) {
+  ZLIB_UDATA(L)
+  size_t len;
+  const unsigned char *src = _zlib_input(L, 2, &len);
+  int rc;
+
+  if (z->ended) {
+    _zlib_push_output(L, z, z->used);
+    lua_pushboolean(L, 1);
+    return 2;
+  }
+  rc = _zlib_run(L, z, src, len, Z_FINISH);
+  if (z->inflate && rc == Z_OK && !z->ended) {
+    lua_pop(L, 1);
+    lua_pushnil(L);
+    lua_pushliteral(L, "unexpected end of stream");
+    return 2;
+  }
+  return _zlib_results(L, z, rc);
+}
+
+/* reset(stream) -> stream -- start a new stream with the same options */
+static int zlib_reset(lua_State *L) {
+  ZLIB_UDATA(L)
+
+  if (z->inflate) {
+    inflateReset(&z->strm);
+  } else {
+    deflateReset(&z->strm);
+  }
+  z->ended = 0;
+  lua_settop(L, 1);
+  return 1;
+}
+
+/* stats(stream) -> bytes in, bytes out, ended */
+static int zlib_stats(lua_State *L) {
+  ZLIB_UDATA(L)
+
+  lua_pushnumber(L, z->strm.total_in);
+  lua_pushnumber(L, z->strm.total_out);
+  lua_pushboolean(L, z->ended);
+  return 3;
+}
+
+static void _zlib_close(lev_zlib_t *z) {
+  if (z->ready) {
+    if (z->inflate) {
+      inflateEnd(&z->strm);
+    } else {
+      deflateEnd(&z->strm);
+    }
+    z->ready = 0;
+  }
+  _zlib_release(z);
+}
+
+/* close(stream) -- free zlib's state now instead of at collection */
+static int zlib_close(lua_State *L) {
+  lev_zlib_t *z = luaL_checkudata(L, 1, "lev.zlib");
+  _zlib_close(z);
+  return 0;
+}
+
+/* __gc(stream) */
+static int zlib__gc(lua_State *L) {
+  lev_zlib_t *z = luaL_checkudata(L, 1, "lev.zlib");
+  _zlib_close(z);
+  return 0;
+}
+
+static luaL_reg methods[] = {
+   { "write",  zlib_write  }
+  ,{ "finish", zlib_finish }
+  ,{ "reset",  zlib_reset  }
+  ,{ "stats",  zlib_stats  }
+  ,{ "close",  zlib_close  }
+
+   /* meta */
+  ,{ "__gc",   zlib__gc    }
+  ,{ NULL, NULL }
+};
+
+static luaL_reg functions[] = {
+   { "deflate", zlib_deflate }
+  ,{ "inflate", zlib_inflate }
+  ,{ NULL, NULL }
+};
+
+
+void luaopen_lev_zlib(lua_State *L) {
+  luaL_newmetatable(L, "lev.zlib");
+  luaL_register(L, NULL, methods);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
+  lua_createtable(L, 0, ARRAY_SIZE(functions) - 1);
+  luaL_register(L, NULL, functions);
+  lua_pushstring(L, ZLIB_VERSION);
+  lua_setfield(L, -2, "version");
+  lua_setfield(L, -2, "zlib");
+}
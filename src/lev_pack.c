@@ -0,0 +1,326 @@
+/*
+ *  Copyright 2012 connectFree k.k. and the lev authors. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#include <string.h>
+#include "lev_pack.h"
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define PACK_HOST_BIG 1
+#else
+#define PACK_HOST_BIG 0
+#endif
+
+/* X:S compile */
+
+/* optional byte count after a format letter; def when absent, -1 if malformed */
+static long pack_digits(const char **fmt, const char *end, long def) {
+  const char *p = *fmt;
+  long n = 0;
+
+  if (p == end || *p < '0' || *p > '9') {
+    return def;
+  }
+  while (p < end && *p >= '0' && *p <= '9') {
+    n = n * 10 + (*p++ - '0');
+    if (n > 0x7fffffff) {
+      return -1;
+    }
+  }
+  *fmt = p;
+  return n;
+}
+
+static int pack_width_ok(long n) {
+  return n == 1 || n == 2 || n == 4 || n == 8;
+}
+
+int lev_pack_compile(lev_pack_plan_t *plan, const char *fmt, size_t fmt_len, const char **err) {
+  const char *end = fmt + fmt_len;
+  int big = PACK_HOST_BIG;
+  lev_pack_op_t *op;
+  long n;
+  char c;
+
+  plan->count = 0;
+  plan->values = 0;
+  plan->fixed = 0;
+  plan->variable = 0;
+
+  while (fmt < end) {
+    c = *fmt++;
+    switch (c) {
+      case ' ':
+        continue;
+      case '<':
+        big = 0;
+        continue;
+      case '>':
+        big = 1;
+        continue;
+      case '=':
+        big = PACK_HOST_BIG;
+        continue;
+    }
+
+    if (plan->count == LEV_PACK_MAX_OPS) {
+      *err = "too many fields in format";
+      return -1;
+    }
+    op = &plan->ops[plan->count++];
+    op->swap = big != PACK_HOST_BIG;
+    op->sign = 0;
+    op->len = 0;
+
+    switch (c) {
+      case 'b': case 'B':
+        op->code = LEV_PACK_INT;
+        op->size = 1;
+        op->sign = c == 'b';
+        break;
+      case 'h': case 'H':
+        op->code = LEV_PACK_INT;
+        op->size = 2;
+        op->sign = c == 'h';
+        break;
+      case 'i': case 'I':
+        n = pack_digits(&fmt, end, 4);
+        if (!pack_width_ok(n)) {
+          *err = "integer size must be 1, 2, 4 or 8";
+          return -1;
+        }
+        op->code = LEV_PACK_INT;
+        op->size = (unsigned char)n;
+        op->sign = c == 'i';
+        break;
+      case 'l': case 'L':
+        op->code = LEV_PACK_INT;
+        op->size = 8;
+        op->sign = c == 'l';
+        break;
+      case 'f': case 'd':
+        op->code = LEV_PACK_FLOAT;
+        op->size = c == 'f' ? 4 : 8;
+        break;
+      case 'v': case 'w':
+        op->code = LEV_PACK_VARINT;
+        op->size = 0;
+        op->sign = c == 'w';
+        break;
+      case 'c':
+        n = pack_digits(&fmt, end, -1);
+        if (n < 1) {
+          *err = "missing size for 'c'";
+          return -1;
+        }
+        op->code = LEV_PACK_FIXED;
+        op->size = 0;
+        op->len = (size_t)n;
+        break;
+      case 's':
+        n = pack_digits(&fmt, end, 4);
+        if (!pack_width_ok(n)) {
+          *err = "string length size must be 1, 2, 4 or 8";
+          return -1;
+        }
+        op->code = LEV_PACK_STRING;
+        op->size = (unsigned char)n;
+        break;
+      case 'z':
+        op->code = LEV_PACK_CSTRING;
+        op->size = 0;
+        break;
+      case 'x':
+        op->code = LEV_PACK_PAD;
+        op->size = 1;
+        break;
+      default:
+        *err = "invalid format option";
+        return -1;
+    }
+
+    if (op->code != LEV_PACK_PAD) {
+      plan->values++;
+    }
+    switch (op->code) {
+      case LEV_PACK_VARINT:
+      case LEV_PACK_CSTRING:
+        plan->variable = 1;
+        break;
+      case LEV_PACK_STRING:
+        plan->variable = 1;
+        plan->fixed += op->size;
+        break;
+      case LEV_PACK_FIXED:
+        plan->fixed += op->len;
+        break;
+      default:
+        plan->fixed += op->size;
+    }
+  }
+
+  return 0;
+}
+
+/* X:E compile */
+
+/* X:S fixed width */
+
+/* byte order is handled on the whole word so each field is one load/store */
+static uint64_t pack_swap(uint64_t v, int size) {
+  switch (size) {
+    case 2:
+      return ((v & 0xff) << 8) | ((v >> 8) & 0xff);
+    case 4:
+      return ((v & 0xff) << 24) | ((v & 0xff00) << 8)
+           | ((v >> 8) & 0xff00) | ((v >> 24) & 0xff);
+    case 8:
+      return (pack_swap(v & 0xffffffff, 4) << 32) | pack_swap(v >> 32, 4);
+  }
+  return v;
+}
+
+void lev_pack_put(unsigned char *p, const lev_pack_op_t *op, uint64_t value) {
+  uint8_t v8;
+  uint16_t v16;
+  uint32_t v32;
+
+  if (op->swap) {
+    value = pack_swap(value, op->size);
+  }
+  switch (op->size) {
+    case 1:
+      v8 = (uint8_t)value;
+      *p = v8;
+      break;
+    case 2:
+      v16 = (uint16_t)value;
+      memcpy(p, &v16, 2);
+      break;
+    case 4:
+      v32 = (uint32_t)value;
+      memcpy(p, &v32, 4);
+      break;
+    case 8:
+      memcpy(p, &value, 8);
+      break;
+  }
+}
+
+uint64_t lev_pack_get(const unsigned char *p, const lev_pack_op_t *op) {
+  uint64_t value = 0;
+  uint16_t v16;
+  uint32_t v32;
+
+  switch (op->size) {
+    case 1:
+      value = *p;
+      break;
+    case 2:
+      memcpy(&v16, p, 2);
+      value = v16;
+      break;
+    case 4:
+      memcpy(&v32, p, 4);
+      value = v32;
+      break;
+    case 8:
+      memcpy(&value, p, 8);
+      break;
+  }
+  if (op->swap) {
+    value = pack_swap(value, op->size);
+  }
+  if (op->sign && op->size < 8 && (value >> (op->size * 8 - 1)) & 1) {
+    value |= ~(uint64_t)0 << (op->size * 8); /* sign extend */
+  }
+  return value;
+}
+
+void lev_pack_put_float(unsigned char *p, const lev_pack_op_t *op, double value) {
+  float f;
+  uint32_t v32;
+  uint64_t v64;
+
+  if (op->size == 4) {
+    f = (float)value;
+    memcpy(&v32, &f, 4);
+    lev_pack_put(p, op, v32);
+  } else {
+    memcpy(&v64, &value, 8);
+    lev_pack_put(p, op, v64);
+  }
+}
+
+double lev_pack_get_float(const unsigned char *p, const lev_pack_op_t *op) {
+  float f;
+  double d;
+  uint32_t v32;
+  uint64_t v64 = lev_pack_get(p, op);
+
+  if (op->size == 4) {
+    v32 = (uint32_t)v64;
+    memcpy(&f, &v32, 4);
+    return f;
+  }
+  memcpy(&d, &v64, 8);
+  return d;
+}
+
+/* X:E fixed width */
+
+/* X:S varint */
+
+size_t lev_pack_varint_size(uint64_t value) {
+  size_t n = 1;
+
+  while (value >= 0x80) {
+    value >>= 7;
+    n++;
+  }
+  return n;
+}
+
+size_t lev_pack_put_varint(unsigned char *p, uint64_t value) {
+  unsigned char *start = p;
+
+  while (value >= 0x80) {
+    *p++ = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  *p++ = (unsigned char)value;
+  return (size_t)(p - start);
+}
+
+/* bytes consumed, or 0 if the varint is truncated or longer than 64 bits */
+size_t lev_pack_get_varint(const unsigned char *p, size_t len, uint64_t *value) {
+  uint64_t v = 0;
+  size_t i;
+
+  if (len > LEV_PACK_MAX_VARINT) {
+    len = LEV_PACK_MAX_VARINT;
+  }
+  for (i = 0; i < len; i++) {
+    v |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+    if (!(p[i] & 0x80)) {
+      *value = v;
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+/* X:E varint */
@@ -0,0 +1,80 @@
+/*
+ *  Copyright 2012 connectFree k.k. and the lev authors. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef _LEV_PACK_H_
+#define _LEV_PACK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  binary pack/unpack formats for lev.buffer. a format string is compiled
+  into a plan once; buffer:pack()/unpack() then walk the plan in a single
+  C call. the syntax follows Lua 5.3's string.pack:
+
+    < > =      little / big / native endian for what follows
+    b B        signed / unsigned  8 bit int
+    h H        signed / unsigned 16 bit int
+    i[n] I[n]  signed / unsigned int of n bytes (1, 2, 4 or 8; default 4)
+    l L        signed / unsigned 64 bit int
+    f d        float / double
+    v w        unsigned LEB128 varint / zigzag signed varint
+    c<n>       fixed string of n bytes, zero padded when packing
+    s[n]       string prefixed by its length as an n byte unsigned int (default 4)
+    z          zero terminated string
+    x          one zero byte of padding
+*/
+
+#define LEV_PACK_MAX_OPS 64 /* fields in one format */
+#define LEV_PACK_MAX_VARINT 10 /* bytes in a 64 bit LEB128 varint */
+
+#define LEV_PACK_INT     0
+#define LEV_PACK_FLOAT   1
+#define LEV_PACK_VARINT  2
+#define LEV_PACK_FIXED   3 /* c<n> */
+#define LEV_PACK_STRING  4 /* s[n] */
+#define LEV_PACK_CSTRING 5 /* z */
+#define LEV_PACK_PAD     6 /* x */
+
+typedef struct _lev_pack_op {
+  unsigned char code;   /* LEV_PACK_* */
+  unsigned char size;   /* width in bytes; the length prefix width for s[n] */
+  unsigned char swap;   /* byte order differs from the host */
+  unsigned char sign;   /* signed int / zigzag varint */
+  size_t len;           /* c<n> */
+} lev_pack_op_t;
+
+typedef struct _lev_pack_plan {
+  int count;    /* ops in use */
+  int values;   /* Lua values packed / unpacked; padding takes none */
+  size_t fixed; /* bytes taken by the fixed width fields */
+  int variable; /* varints or strings present: size depends on the values */
+  lev_pack_op_t ops[LEV_PACK_MAX_OPS];
+} lev_pack_plan_t;
+
+int lev_pack_compile(lev_pack_plan_t *plan, const char *fmt, size_t fmt_len, const char **err);
+
+void lev_pack_put(unsigned char *p, const lev_pack_op_t *op, uint64_t value);
+uint64_t lev_pack_get(const unsigned char *p, const lev_pack_op_t *op);
+void lev_pack_put_float(unsigned char *p, const lev_pack_op_t *op, double value);
+double lev_pack_get_float(const unsigned char *p, const lev_pack_op_t *op);
+
+size_t lev_pack_varint_size(uint64_t value);
+size_t lev_pack_put_varint(unsigned char *p, uint64_t value);
+size_t lev_pack_get_varint(const unsigned char *p, size_t len, uint64_t *value);
+
+#endif
@@ -0,0 +1,397 @@
+/*
+ *  Copyright 2012 connectFree k.k. and the lev authors. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "lev_search.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+  #define LEV_SEARCH_SSE2 /* part of the x86_64 baseline */
+  #include <emmintrin.h>
+  #if defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+    #define LEV_SEARCH_AVX2 /* compiled per function, used only if the CPU has it */
+    #include <immintrin.h>
+  #endif
+#endif
+
+typedef const unsigned char *(*lev_search_fn)(const unsigned char *, size_t,
+                                              const unsigned char *, size_t);
+
+/* X:S generic */
+
+/* Mac OS X < 10.7.x has no "memmem" */
+#if !((!defined(__GNUC__) || __GNUC__ >= 2) && !defined(__APPLE__))
+#undef memmem
+/* memmem implementation from fbsd */
+/* Copyright (c) 2005 Pascal Gloor <pascal.gloor@spale.com> */
+/* http://opensource.apple.com/source/Libc/Libc-763.12/string/memmem-fbsd.c */
+static void *my_memmem(l, l_len, s, s_len)
+  const void *l; size_t l_len;
+  const void *s; size_t s_len;
+{
+  register char *cur, *last;
+  const char *cl = (const char *)l;
+  const char *cs = (const char *)s;
+
+  /* we need something to compare */
+  if (l_len == 0 || s_len == 0) {
+    return NULL;
+  }
+
+  /* "s" must be smaller or equal to "l" */
+  if (l_len < s_len) {
+    return NULL;
+  }
+
+  /* special case where s_len == 1 */
+  if (s_len == 1) {
+    return memchr(l, (int)*cs, l_len);
+  }
+
+  /* the last position where its possible to find "s" in "l" */
+  last = (char *)cl + l_len - s_len;
+
+  for (cur = (char *)cl; cur <= last; cur++) {
+    if (cur[0] == cs[0] && memcmp(cur, cs, s_len) == 0) {
+      return cur;
+    }
+  }
+
+  return NULL;
+}
+
+#define memmem my_memmem
+
+#endif
+
+static const unsigned char *search_generic(const unsigned char *hay, size_t n,
+                                           const unsigned char *needle, size_t m) {
+  return (const unsigned char *)memmem(hay, n, needle, m);
+}
+
+/* X:E generic */
+
+/*
+  the SIMD kernels compare the first and the last byte of the needle
+  against a whole vector of candidate positions at once and only memcmp
+  where both match -- cheap even for needles like "\r\n\r\n".
+*/
+
+#ifdef LEV_SEARCH_SSE2
+
+static const unsigned char *search_sse2(const unsigned char *hay, size_t n,
+                                        const unsigned char *needle, size_t m) {
+  __m128i first, last, block_first, block_last;
+  unsigned int mask;
+  size_t i;
+  int bit;
+
+  if (m < 2 || m > n) {
+    return search_generic(hay, n, needle, m);
+  }
+
+  first = _mm_set1_epi8((char)needle[0]);
+  last = _mm_set1_epi8((char)needle[m - 1]);
+
+  for (i = 0; i + m - 1 + 16 <= n; i += 16) {
+    block_first = _mm_loadu_si128((const __m128i *)(hay + i));
+    block_last = _mm_loadu_si128((const __m128i *)(hay + i + m - 1));
+    mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(
+             _mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+    while (mask) {
+      bit = __builtin_ctz(mask);
+      if (!memcmp(hay + i + bit + 1, needle + 1, m - 2)) {
+        return hay + i + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  return search_generic(hay + i, n - i, needle, m);
+}
+
+#endif
+
+#ifdef LEV_SEARCH_AVX2
+
+__attribute__((target("avx2")))
+static const unsigned char *search_avx2(const unsigned char *hay, size_t n,
+                                        const unsigned char *needle, size_t m) {
+  __m256i first, last, block_first, block_last;
+  unsigned int mask;
+  size_t i;
+  int bit;
+
+  if (m < 2 || m > n) {
+    return search_generic(hay, n, needle, m);
+  }
+
+  first = _mm256_set1_epi8((char)needle[0]);
+  last = _mm256_set1_epi8((char)needle[m - 1]);
+
+  for (i = 0; i + m - 1 + 32 <= n; i += 32) {
+    block_first = _mm256_loadu_si256((const __m256i *)(hay + i));
+    block_last = _mm256_loadu_si256((const __m256i *)(hay + i + m - 1));
+    mask = (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(
+             _mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last)));
+    while (mask) {
+      bit = __builtin_ctz(mask);
+      if (!memcmp(hay + i + bit + 1, needle + 1, m - 2)) {
+        return hay + i + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  return search_sse2(hay + i, n - i, needle, m);
+}
+
+#endif
+
+/* X:S dispatch */
+
+static struct {
+  const char *name;
+  lev_search_fn fn;
+} search_kernels[] = {
+   { "generic", search_generic }
+#ifdef LEV_SEARCH_SSE2
+  ,{ "sse2",    search_sse2    }
+#endif
+#ifdef LEV_SEARCH_AVX2
+  ,{ "avx2",    search_avx2    }
+#endif
+};
+
+#define SEARCH_KERNEL_COUNT (int)(sizeof(search_kernels) / sizeof(search_kernels[0]))
+
+static int search_kernel = -1;
+
+static int _lev_search_supported(int i) {
+#ifdef LEV_SEARCH_AVX2
+  if (search_kernels[i].fn == search_avx2) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+  }
+#endif
+  return 1;
+}
+
+static void _lev_search_init() {
+  int i;
+
+  if (lev_search_set_kernel(getenv("LEV_SEARCH_KERNEL")) == 0) {
+    return;
+  }
+  for (i = SEARCH_KERNEL_COUNT - 1; i > 0 && !_lev_search_supported(i); i--)
+    ;
+  search_kernel = i; /* the best one this CPU runs */
+}
+
+#define SEARCH_KERNEL() \
+  (search_kernel < 0 ? _lev_search_init() : (void)0, search_kernels[search_kernel].fn)
+
+/* returns -1 if name is unknown or this CPU cannot run it */
+int lev_search_set_kernel(const char *name) {
+  int i;
+
+  if (!name) {
+    return -1;
+  }
+  for (i = 0; i < SEARCH_KERNEL_COUNT; i++) {
+    if (!strcmp(name, search_kernels[i].name) && _lev_search_supported(i)) {
+      search_kernel = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+const char *lev_search_kernel_name() {
+  if (search_kernel < 0) {
+    _lev_search_init();
+  }
+  return search_kernels[search_kernel].name;
+}
+
+const unsigned char *lev_search(const unsigned char *hay, size_t hay_len,
+                                const unsigned char *needle, size_t needle_len) {
+  if (!needle_len || needle_len > hay_len) {
+    return NULL;
+  }
+  return SEARCH_KERNEL()(hay, hay_len, needle, needle_len);
+}
+
+/* X:E dispatch */
+
+/* X:S needles */
+
+#define FIRSTS_HAS(n, c) ((n)->firsts[(c) >> 3] & (1 << ((c) & 7)))
+
+void lev_needle_init(lev_needle_t *n) {
+  memset(n, 0, sizeof(*n));
+}
+
+/* append an alternative; the caller sized n with lev_needle_sizeof() */
+int lev_needle_add(lev_needle_t *n, const unsigned char *bytes, size_t len) {
+  if (!len || n->count == LEV_SEARCH_MAX_NEEDLES) {
+    return -1;
+  }
+  memcpy(n->bytes + n->total, bytes, len);
+  n->len[n->count] = len;
+  n->offset[n->count] = n->total;
+  n->firsts[bytes[0] >> 3] |= 1 << (bytes[0] & 7);
+  n->total += len;
+  n->count++;
+  return 0;
+}
+
+/* the lowest numbered alternative that matches at p, or -1 */
+static int _lev_needle_match(const lev_needle_t *n, const unsigned char *p, size_t avail) {
+  int i;
+
+  for (i = 0; i < n->count; i++) {
+    if (n->len[i] <= avail && !memcmp(p, n->bytes + n->offset[i], n->len[i])) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+#ifdef LEV_SEARCH_SSE2
+
+/* one cmpeq per distinct first byte, then verify the candidates */
+static const unsigned char *needle_find_sse2(const lev_needle_t *n, const unsigned char *hay,
+                                             size_t hay_len, int *which) {
+  __m128i firsts[LEV_SEARCH_MAX_NEEDLES];
+  __m128i block, hits;
+  unsigned int mask;
+  int nfirsts = 0;
+  int i, j, bit;
+  size_t at;
+
+  for (i = 0; i < n->count; i++) {
+    for (j = 0; j < i && n->bytes[n->offset[j]] != n->bytes[n->offset[i]]; j++)
+      ;
+    if (j == i) {
+      firsts[nfirsts++] = _mm_set1_epi8((char)n->bytes[n->offset[i]]);
+    }
+  }
+
+  for (at = 0; at + 16 <= hay_len; at += 16) {
+    block = _mm_loadu_si128((const __m128i *)(hay + at));
+    hits = _mm_cmpeq_epi8(firsts[0], block);
+    for (i = 1; i < nfirsts; i++) {
+      hits = _mm_or_si128(hits, _mm_cmpeq_epi8(firsts[i], block));
+    }
+    mask = (unsigned int)_mm_movemask_epi8(hits);
+    while (mask) {
+      bit = __builtin_ctz(mask);
+      *which = _lev_needle_match(n, hay + at + bit, hay_len - at - bit);
+      if (*which >= 0) {
+        return hay + at + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  for (; at < hay_len; at++) {
+    if (FIRSTS_HAS(n, hay[at])) {
+      *which = _lev_needle_match(n, hay + at, hay_len - at);
+      if (*which >= 0) {
+        return hay + at;
+      }
+    }
+  }
+  return NULL;
+}
+
+#endif
+
+/* earliest match of any alternative; *which gets its (0 based) index */
+const unsigned char *lev_needle_find(const lev_needle_t *n, const unsigned char *hay,
+                                     size_t hay_len, int *which) {
+  size_t at;
+
+  *which = -1;
+  if (!n->count) {
+    return NULL;
+  }
+  if (n->count == 1) {
+    *which = 0;
+    return lev_search(hay, hay_len, n->bytes, n->len[0]);
+  }
+
+#ifdef LEV_SEARCH_SSE2
+  if (SEARCH_KERNEL() != search_generic) {
+    return needle_find_sse2(n, hay, hay_len, which);
+  }
+#endif
+
+  for (at = 0; at < hay_len; at++) {
+    if (FIRSTS_HAS(n, hay[at])) {
+      *which = _lev_needle_match(n, hay + at, hay_len - at);
+      if (*which >= 0) {
+        return hay + at;
+      }
+    }
+  }
+  return NULL;
+}
+
+/* X:E needles */
+
+/* X:S reverse */
+
+/*
+  the last match starting in hay. the needle's last byte is located first
+  (memrchr where glibc has it, which is vectorized) and the rest compared
+  from there, so misses cost one pass over the haystack.
+*/
+const unsigned char *lev_search_last(const unsigned char *hay, size_t hay_len,
+                                     const unsigned char *needle, size_t needle_len) {
+  const unsigned char *p;
+  unsigned char last;
+  size_t end; /* one past where the needle's last byte may still be */
+
+  if (!needle_len || needle_len > hay_len) {
+    return NULL;
+  }
+  last = needle[needle_len - 1];
+  end = hay_len;
+  while (end >= needle_len) {
+#ifdef __GLIBC__
+    p = memrchr(hay + needle_len - 1, last, end - needle_len + 1);
+    if (!p) {
+      return NULL;
+    }
+#else
+    for (p = hay + end - 1; *p != last; p--) {
+      if (p == hay + needle_len - 1) {
+        return NULL;
+      }
+    }
+#endif
+    if (!memcmp(p - needle_len + 1, needle, needle_len - 1)) {
+      return p - needle_len + 1;
+    }
+    end = (size_t)(p - hay);
+  }
+  return NULL;
+}
+
+/* X:E reverse */
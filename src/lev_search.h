@@ -0,0 +1,55 @@
+/*
+ *  Copyright 2012 connectFree k.k. and the lev authors. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+#ifndef _LEV_SEARCH_H_
+#define _LEV_SEARCH_H_
+
+#include <stddef.h>
+
+/*
+  substring search for lev.buffer. the kernel (generic memmem, SSE2 or
+  AVX2) is picked once from the running CPU; LEV_SEARCH_KERNEL or
+  lev_search_set_kernel() can force one for benchmarking.
+*/
+
+#define LEV_SEARCH_MAX_NEEDLES 8 /* alternatives in one multi-needle */
+
+/* a precompiled needle; the bytes of every alternative follow the struct */
+typedef struct _lev_needle {
+  int count;                            /* number of alternatives */
+  size_t len[LEV_SEARCH_MAX_NEEDLES];
+  size_t offset[LEV_SEARCH_MAX_NEEDLES]; /* of each alternative in bytes[] */
+  size_t total;                         /* bytes used in bytes[] */
+  unsigned char firsts[256 / 8];        /* bitmap of every first byte */
+  unsigned char bytes[0];
+} lev_needle_t;
+
+const char *lev_search_kernel_name();
+int lev_search_set_kernel(const char *name);
+
+const unsigned char *lev_search(const unsigned char *hay, size_t hay_len,
+                                const unsigned char *needle, size_t needle_len);
+const unsigned char *lev_search_last(const unsigned char *hay, size_t hay_len,
+                                     const unsigned char *needle, size_t needle_len);
+
+#define lev_needle_sizeof(total) (sizeof(lev_needle_t) + (total))
+void lev_needle_init(lev_needle_t *n);
+int lev_needle_add(lev_needle_t *n, const unsigned char *bytes, size_t len);
+const unsigned char *lev_needle_find(const lev_needle_t *n, const unsigned char *hay,
+                                     size_t hay_len, int *which);
+
+#endif
@@ -17,94 +17,805 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "lev_slab.h"
 
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+  #define MAP_ANONYMOUS MAP_ANON
+#endif
+
 #ifndef MIN
   #define MIN(a,b) (((a) < (b)) ? (a) : (b))
 #endif
 
-const static lev_slab_allocator_t mem_1k;
-const static lev_slab_allocator_t mem_8k;
-const static lev_slab_allocator_t mem_16k;
-const static lev_slab_allocator_t mem_64k;
-const static lev_slab_allocator_t mem_1024k;
+#ifndef MAX
+  #define MAX(a,b) (((a) > (b)) ? (a) : (b))
+#endif
+
+static lev_slab_allocator_t slab_classes[SLAB_MAX_CLASSES];
+static int slab_class_count = 0;
+
+#define SLAB_CLASS_COUNT slab_class_count
+
+static size_t slab_histogram[SLAB_HISTOGRAM_BUCKETS];
 
 #define lev_slab_offsetof(type, member) ((unsigned long)&((type *)0)->member)
 
+/* X:S debug */
+
+#ifdef LEV_SLAB_DEBUG
+
 static void corrupted_canary(const void * object) __attribute__((noreturn));
 static void corrupted_canary(const void * object) {
   printf("memory overrun on object %p\n", object);
   abort();
 }
 
+static MemBlock *slab_live = NULL; /* every block currently handed out */
+
+static void _lev_slab_arm(MemBlock *mb) {
+  unsigned int canary = SLAB_CANARY;
+  mb->canary = canary;
+  memcpy(mb->bytes + mb->size, &canary, SLAB_TAIL); /* tail may be unaligned */
+}
+
+static void _lev_slab_check(MemBlock *mb) {
+  unsigned int tail;
+  memcpy(&tail, mb->bytes + mb->size, SLAB_TAIL);
+  if (mb->canary != SLAB_CANARY || tail != SLAB_CANARY) {
+    fprintf(stderr, "*lev: slab block %p allocated at %s:%d\n", mb, mb->file, mb->line);
+    corrupted_canary(mb);
+  }
+}
+
+static void _lev_slab_track(MemBlock *mb, const char *file, int line) {
+  mb->file = file;
+  mb->line = line;
+  mb->live_prev = NULL;
+  mb->live_next = slab_live;
+  if (slab_live) {
+    slab_live->live_prev = mb;
+  }
+  slab_live = mb;
+}
+
+static void _lev_slab_untrack(MemBlock *mb) {
+  if (mb->live_prev) {
+    mb->live_prev->live_next = mb->live_next;
+  } else {
+    slab_live = mb->live_next;
+  }
+  if (mb->live_next) {
+    mb->live_next->live_prev = mb->live_prev;
+  }
+  mb->live_prev = mb->live_next = NULL;
+}
+
+/* pooled blocks are filled with SLAB_POISON so stale readers see garbage */
+static void _lev_slab_poison(MemBlock *mb) {
+  memset(mb->bytes, SLAB_POISON, mb->size);
+  _lev_slab_arm(mb);
+}
+
+/* and anything but SLAB_POISON when they leave the pool means a write after free */
+static void _lev_slab_check_poison(MemBlock *mb) {
+  size_t i;
+
+  _lev_slab_check(mb);
+  for (i = 0; i < mb->size; i++) {
+    if (mb->bytes[i] != SLAB_POISON) {
+      fprintf(stderr, "*lev: write after free at offset %lu of slab block %p, last allocated at %s:%d\n",
+        (unsigned long)i, mb, mb->file, mb->line);
+      abort();
+    }
+  }
+}
+
+static void _lev_slab_leak_report() {
+  MemBlock *mb;
+  size_t count = 0, bytes = 0;
+
+  for (mb = slab_live; mb; mb = mb->live_next) {
+    fprintf(stderr, "*lev: leaked slab block %p (%lu bytes, refcount %d) allocated at %s:%d\n",
+      mb, (unsigned long)mb->size, mb->refcount, mb->file, mb->line);
+    count++;
+    bytes += mb->size;
+  }
+  if (count) {
+    fprintf(stderr, "*lev: %lu slab blocks (%lu bytes) still live at exit\n",
+      (unsigned long)count, (unsigned long)bytes);
+  }
+}
+
+#endif
+
+/* X:E debug */
+
+
+static double slab_decay = SLAB_DEFAULT_DECAY;
+static int slab_prefill = LEV_SLAB_PREFILL_LAZY;
+
+static void _lev_slab_set_peak(lev_slab_allocator_t *allocator, double peak) {
+  allocator->peak = peak;
+  allocator->pool_target = (int)(peak + 0.5);
+}
+
+static void _lev_slab_push(lev_slab_allocator_t *allocator, MemBlock *mb) {
+#ifdef LEV_SLAB_DEBUG
+  _lev_slab_poison(mb);
+#endif
+  mb->next = allocator->pool;
+  allocator->pool = mb;
+  allocator->pool_count++;
+}
+
+static MemBlock *_lev_slab_pop(lev_slab_allocator_t *allocator) {
+  MemBlock *mb = allocator->pool;
+  allocator->pool = mb->next;
+  allocator->pool_count--;
+#ifdef LEV_SLAB_DEBUG
+  _lev_slab_check_poison(mb);
+#endif
+  return mb;
+}
+
+/* X:S arena backend */
+
+#define SLAB_ARENA_CHUNK (2*1024*1024) /* one huge page on x86_64 */
+#define SLAB_ARENA_ALIGN 64            /* keep every block cacheline aligned */
+
+#define SLAB_ALIGN_UP(n, a) (((n) + (a) - 1) & ~((size_t)(a) - 1))
+
+static int slab_backend = LEV_SLAB_BACKEND_MALLOC;
+static int slab_hugetlb = 0; /* did MAP_HUGETLB ever succeed? */
+
+static unsigned char *_lev_slab_arena_map(size_t size) {
+  void *p = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+  /* only succeeds when the admin reserved huge pages (vm.nr_hugepages) */
+  p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+  if (p != MAP_FAILED) {
+    slab_hugetlb = 1;
+    return (unsigned char *)p;
+  }
+#endif
+
+  p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    return NULL;
+  }
+#ifdef MADV_HUGEPAGE
+  madvise(p, size, MADV_HUGEPAGE); /* ask for transparent huge pages instead */
+#endif
+  return (unsigned char *)p;
+}
+
+static MemBlock *_lev_slab_arena_carve(lev_slab_allocator_t *allocator) {
+  size_t stride = SLAB_ALIGN_UP(sizeof(MemBlock) + allocator->blocksize + SLAB_TAIL, SLAB_ARENA_ALIGN);
+  size_t chunk;
+  MemBlock *mb;
+
+  if (allocator->released) { /* reuse a hollow block before growing the arena */
+    mb = allocator->released;
+    allocator->released = mb->next;
+    allocator->released_count--;
+    return mb;
+  }
+
+  if (!allocator->arena_cur || allocator->arena_cur + stride > allocator->arena_end) {
+    chunk = SLAB_ALIGN_UP(stride * 4, SLAB_ARENA_CHUNK);
+    allocator->arena_cur = _lev_slab_arena_map(chunk);
+    if (!allocator->arena_cur) {
+      allocator->arena_end = NULL;
+      return NULL;
+    }
+    allocator->arena_end = allocator->arena_cur + chunk;
+    allocator->stats.mapped_bytes += chunk;
+  }
+
+  mb = (MemBlock *)allocator->arena_cur;
+  allocator->arena_cur += stride;
+  return mb;
+}
+
+/* keep the block header (and free list link) but return its pages */
+static void _lev_slab_arena_release(lev_slab_allocator_t *allocator, MemBlock *mb) {
+#ifdef MADV_DONTNEED
+  static size_t pagesize = 0;
+  uintptr_t from, to;
+
+  if (!pagesize) {
+    pagesize = (size_t)sysconf(_SC_PAGESIZE);
+  }
+  from = SLAB_ALIGN_UP((uintptr_t)mb->bytes, pagesize);
+  to = ((uintptr_t)mb->bytes + allocator->blocksize) & ~((uintptr_t)pagesize - 1);
+  if (to > from) {
+    madvise((void *)from, to - from, MADV_DONTNEED);
+  }
+#endif
+  mb->next = allocator->released;
+  allocator->released = mb;
+  allocator->released_count++;
+}
+
+/* X:E arena backend */
+
+/* X:S size classes */
+
+static int _lev_slab_class_cmp(const void *a, const void *b) {
+  size_t x = ((const lev_slab_allocator_t *)a)->blocksize;
+  size_t y = ((const lev_slab_allocator_t *)b)->blocksize;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/*
+  spec is a comma separated list of block sizes with an optional k/m
+  suffix and an optional ":count" of blocks to prefill, e.g.
+  "1k:1024,2k,4k,8k:512". order does not matter; duplicates are dropped.
+  must be called before lev_slab_fill(). returns -1 on a malformed spec.
+*/
+int lev_slab_set_classes(const char *spec) {
+  lev_slab_allocator_t parsed[SLAB_MAX_CLASSES];
+  const char *p = spec;
+  char *end;
+  unsigned long size, prefill;
+  int count = 0;
+  int i, j;
+
+  if (!spec) {
+    return -1;
+  }
+
+  memset(parsed, 0, sizeof(parsed));
+  while (*p) {
+    size = strtoul(p, &end, 10);
+    if (end == p) {
+      return -1;
+    }
+    p = end;
+    if (*p == 'k' || *p == 'K') {
+      size *= 1024;
+      p++;
+    } else if (*p == 'm' || *p == 'M') {
+      size *= 1024*1024;
+      p++;
+    }
+    prefill = 0;
+    if (*p == ':') {
+      p++;
+      prefill = strtoul(p, &end, 10);
+      if (end == p) {
+        return -1;
+      }
+      p = end;
+    }
+    if (*p == ',') {
+      p++;
+    } else if (*p) {
+      return -1;
+    }
+    if (!size || count == SLAB_MAX_CLASSES) {
+      return -1;
+    }
+
+    parsed[count].blocksize = size;
+    parsed[count].prefill = (int)prefill;
+    if (size % (1024*1024) == 0) {
+      snprintf(parsed[count].name, sizeof(parsed[count].name), "%lum", size / (1024*1024));
+    } else if (size % 1024 == 0) {
+      snprintf(parsed[count].name, sizeof(parsed[count].name), "%luk", size / 1024);
+    } else {
+      snprintf(parsed[count].name, sizeof(parsed[count].name), "%lu", size);
+    }
+    count++;
+  }
+  if (!count) {
+    return -1;
+  }
+
+  qsort(parsed, count, sizeof(parsed[0]), _lev_slab_class_cmp);
+  for (i = 0, j = 0; i < count; i++) {
+    if (j && parsed[j - 1].blocksize == parsed[i].blocksize) {
+      continue;
+    }
+    parsed[j++] = parsed[i];
+  }
+
+  memcpy(slab_classes, parsed, sizeof(parsed));
+  slab_class_count = j;
+  return 0;
+}
+
+/* bucket i counts requests of (2^(i-1), 2^i] bytes; the last bucket is open ended */
+static void _lev_slab_histogram_add(size_t size) {
+  int bucket = 0;
+
+  while (bucket < SLAB_HISTOGRAM_BUCKETS - 1 && ((size_t)1 << bucket) < size) {
+    bucket++;
+  }
+  slab_histogram[bucket]++;
+}
+
+size_t lev_slab_histogram(int bucket) {
+  if (bucket < 0 || bucket >= SLAB_HISTOGRAM_BUCKETS) {
+    return 0;
+  }
+  return slab_histogram[bucket];
+}
+
+/* X:E size classes */
+
+int lev_slab_set_backend(const char *name) {
+  if (!name || !strcmp(name, "malloc")) {
+    slab_backend = LEV_SLAB_BACKEND_MALLOC;
+  } else if (!strcmp(name, "arena")) {
+    slab_backend = LEV_SLAB_BACKEND_ARENA;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+const char *lev_slab_backend_name() {
+  if (slab_backend == LEV_SLAB_BACKEND_ARENA) {
+    return slab_hugetlb ? "arena+hugetlb" : "arena";
+  }
+  return "malloc";
+}
+
+/* X:S large-object tier */
+
+/*
+  anything bigger than the largest class gets its own mmap extent.
+  the pool of this pseudo class is a tiny cache of freed extents which
+  is searched best-fit, so a steady stream of similar uploads does not
+  mmap/munmap on every request.
+*/
+static lev_slab_allocator_t slab_large = { "large", 0 };
+
+static size_t _lev_slab_pagesize() {
+  static size_t pagesize = 0;
+  if (!pagesize) {
+    pagesize = (size_t)sysconf(_SC_PAGESIZE);
+  }
+  return pagesize;
+}
+
+static MemBlock *_lev_slab_large_map(size_t size) {
+  size_t map_size = SLAB_ALIGN_UP(sizeof(MemBlock) + size + SLAB_TAIL, _lev_slab_pagesize());
+  MemBlock *mb;
+  void *p;
+
+  p = mmap(NULL, map_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    return NULL;
+  }
+#ifdef MADV_HUGEPAGE
+  if (map_size >= SLAB_ARENA_CHUNK) {
+    madvise(p, map_size, MADV_HUGEPAGE);
+  }
+#endif
+
+  mb = (MemBlock *)p;
+  mb->flags = MEMBLOCK_LARGE;
+  mb->size = map_size - sizeof(MemBlock) - SLAB_TAIL;
+  slab_large.stats.mapped_bytes += map_size;
+  return mb;
+}
+
+static void _lev_slab_large_unmap(MemBlock *mb) {
+  size_t map_size = sizeof(MemBlock) + mb->size + SLAB_TAIL;
+  slab_large.stats.mapped_bytes -= map_size;
+  munmap(mb, map_size);
+}
+
+/* best fit: big enough, but no more than twice what was asked for */
+static MemBlock *_lev_slab_large_cached(size_t size) {
+  MemBlock **link;
+  MemBlock **best = NULL;
+  MemBlock *mb;
+
+  for (link = &slab_large.pool; *link; link = &(*link)->next) {
+    if ((*link)->size >= size && (*link)->size / 2 <= size
+        && (!best || (*link)->size < (*best)->size)) {
+      best = link;
+    }
+  }
+  if (!best) {
+    return NULL;
+  }
+
+  mb = *best;
+  *best = mb->next;
+  slab_large.pool_count--;
+#ifdef LEV_SLAB_DEBUG
+  _lev_slab_check_poison(mb);
+#endif
+  return mb;
+}
+
+static void _lev_slab_large_trim() {
+  while (slab_large.pool) {
+    _lev_slab_large_unmap( _lev_slab_pop(&slab_large) );
+    slab_large.stats.trimmed++;
+  }
+}
+
+static MemBlock *_lev_slab_large_get(size_t size) {
+  MemBlock *mb;
 
-static void _lev_slab_fill(lev_slab_allocator_t *allocator, size_t blocksize, int min_number) {
+  mb = _lev_slab_large_cached(size);
+  if (mb) {
+    slab_large.stats.hits++;
+  } else {
+    mb = _lev_slab_large_map(size);
+    if (!mb) {
+      return NULL;
+    }
+    slab_large.stats.misses++;
+  }
+
+  slab_large.window_gets++;
+  slab_large.stats.requested_bytes += size;
+  slab_large.stats.served_bytes += mb->size;
+  slab_large.stats.live++;
+  slab_large.stats.live_bytes += mb->size;
+  if (slab_large.stats.live > slab_large.stats.high_water) {
+    slab_large.stats.high_water = slab_large.stats.live;
+  }
+  if (slab_large.stats.live > slab_large.window_peak) {
+    slab_large.window_peak = slab_large.stats.live;
+  }
+
+  mb->allocator = &slab_large;
+  mb->next = NULL;
+  mb->refcount = 0;
+  mb->nbytes = 0;
+  mb->sliced = 0;
+  return mb;
+}
+
+static void _lev_slab_large_put(MemBlock *mb) {
+  slab_large.stats.live--;
+  slab_large.stats.live_bytes -= mb->size;
+  if (slab_large.pool_count < SLAB_LARGE_CACHE) {
+    _lev_slab_push(&slab_large, mb);
+  } else {
+    slab_large.stats.frees++;
+    _lev_slab_large_unmap(mb);
+  }
+}
+
+/*
+  grow a large block to hold at least size bytes, letting the kernel
+  move the pages (mremap) instead of copying them. the caller must own
+  the only reference and fix up any pointers into the old block.
+  returns NULL if the block is not a large block or cannot be grown.
+*/
+MemBlock *lev_slab_growBlock(MemBlock *mb, size_t size) {
+  size_t old_map, new_map;
+  MemBlock *grown;
+
+  if (!(mb->flags & MEMBLOCK_LARGE)) {
+    return NULL;
+  }
+  if (size <= mb->size) {
+    return mb;
+  }
+
+  old_map = sizeof(MemBlock) + mb->size + SLAB_TAIL;
+  new_map = SLAB_ALIGN_UP(sizeof(MemBlock) + size + SLAB_TAIL, _lev_slab_pagesize());
+
+#ifdef LEV_SLAB_DEBUG
+  _lev_slab_check(mb);
+  _lev_slab_untrack(mb); /* the header may move; relinked below */
+#endif
+
+#ifdef MREMAP_MAYMOVE
+  grown = (MemBlock *)mremap(mb, old_map, new_map, MREMAP_MAYMOVE);
+  if ((void *)grown == MAP_FAILED) {
+#ifdef LEV_SLAB_DEBUG
+    _lev_slab_track(mb, mb->file, mb->line);
+#endif
+    return NULL;
+  }
+  slab_large.stats.mapped_bytes += new_map - old_map;
+#else
+  grown = _lev_slab_large_map(size);
+  if (!grown) {
+#ifdef LEV_SLAB_DEBUG
+    _lev_slab_track(mb, mb->file, mb->line);
+#endif
+    return NULL;
+  }
+  new_map = sizeof(MemBlock) + grown->size + SLAB_TAIL;
+  memcpy(grown, mb, sizeof(MemBlock) + mb->nbytes);
+  _lev_slab_large_unmap(mb);
+#endif
+
+  grown->size = new_map - sizeof(MemBlock) - SLAB_TAIL;
+  slab_large.stats.live_bytes += new_map - old_map;
+#ifdef LEV_SLAB_DEBUG
+  _lev_slab_arm(grown);
+  _lev_slab_track(grown, grown->file, grown->line);
+#endif
+  return grown;
+}
+
+/* X:E large-object tier */
+
+/* a brand new block from the backend -- never from the pool */
+static MemBlock *_lev_slab_new_block(lev_slab_allocator_t *allocator) {
+  MemBlock *mb;
+
+  if (slab_backend == LEV_SLAB_BACKEND_ARENA) {
+    mb = _lev_slab_arena_carve(allocator);
+    if (mb) {
+      mb->flags = MEMBLOCK_ARENA;
+      mb->size = allocator->blocksize;
+      return mb;
+    }
+    /* could not map an arena; fall through to malloc */
+  }
+
+  mb = (MemBlock *)malloc(sizeof(MemBlock) + allocator->blocksize + SLAB_TAIL);
+  if (mb) {
+    mb->flags = 0;
+    mb->size = allocator->blocksize;
+  }
+  return mb;
+}
+
+/* give a block back to the backend */
+static void _lev_slab_release_block(lev_slab_allocator_t *allocator, MemBlock *mb) {
+  if (mb->flags & MEMBLOCK_ARENA) {
+    _lev_slab_arena_release(allocator, mb);
+  } else {
+    free(mb);
+  }
+}
+
+/* free pooled blocks until we are back under the pool target */
+static void _lev_slab_trim(lev_slab_allocator_t *allocator, int target) {
+  while (allocator->pool
+         && allocator->stats.live + allocator->pool_count > (size_t)target) {
+    _lev_slab_release_block(allocator, _lev_slab_pop(allocator));
+    allocator->stats.trimmed++;
+  }
+}
+
+/*
+  seed the pool target with min_number blocks; the seed decays like any
+  other peak. the blocks themselves are only allocated here when eager,
+  otherwise on first demand or by lev_slab_warm().
+*/
+static void _lev_slab_fill(lev_slab_allocator_t *allocator, int min_number) {
+  allocator->pool = NULL;
   allocator->pool_count = 0;
-  allocator->pool_min = MIN(min_number, SLAB_MAXFREELIST);
-  MemBlock *mb;  
-  while (allocator->pool_count < SLAB_MAXFREELIST) {
-    /* 
-      while() uses SLAB_MAXFREELIST instead of allocator->pool_min
-      to suppress bogus warning: "array subscript is above array bounds"
-    */
-    if (allocator->pool_count == allocator->pool_min) {
-      break;
+  _lev_slab_set_peak(allocator, min_number);
+  if (slab_prefill == LEV_SLAB_PREFILL_EAGER) {
+    while (allocator->pool_count < min_number) {
+      MemBlock *mb = _lev_slab_new_block(allocator);
+      if (!mb) {
+        break; /* out of memory; the pool fills on demand instead */
+      }
+      _lev_slab_push(allocator, mb);
     }
-    mb = (MemBlock *)malloc(sizeof(MemBlock) + blocksize);
-    allocator->pool[allocator->pool_count++] = mb;
   }
-  
 }
 
 void lev_slab_fill() {
-  _lev_slab_fill((lev_slab_allocator_t*)&mem_1k, 1024, 1024);
-  _lev_slab_fill((lev_slab_allocator_t*)&mem_8k, 8*1024, 512);
-  _lev_slab_fill((lev_slab_allocator_t*)&mem_16k, 16*1024, 8);
-  _lev_slab_fill((lev_slab_allocator_t*)&mem_64k, 64*1024, 8);
-  _lev_slab_fill((lev_slab_allocator_t*)&mem_1024k, 1024*1024, 0);
+  const char *classes = getenv("LEV_SLAB_CLASSES");
+  const char *prefill = getenv("LEV_SLAB_PREFILL");
+  int i;
+
+  slab_large.pool_target = SLAB_LARGE_CACHE;
+
+  if (lev_slab_set_backend(getenv("LEV_SLAB_BACKEND"))) {
+    fprintf(stderr, "*lev: unknown LEV_SLAB_BACKEND, using malloc\n");
+  }
+
+  if (classes && lev_slab_set_classes(classes)) {
+    fprintf(stderr, "*lev: malformed LEV_SLAB_CLASSES, using defaults\n");
+    classes = NULL;
+  }
+  if (!classes) {
+    lev_slab_set_classes(SLAB_DEFAULT_CLASSES);
+  }
+
+#ifdef LEV_SLAB_DEBUG
+  atexit(_lev_slab_leak_report);
+#endif
+
+  if (!prefill || !strcmp(prefill, "lazy")) {
+    slab_prefill = LEV_SLAB_PREFILL_LAZY;
+  } else if (!strcmp(prefill, "idle")) {
+    slab_prefill = LEV_SLAB_PREFILL_IDLE;
+  } else if (!strcmp(prefill, "eager")) {
+    slab_prefill = LEV_SLAB_PREFILL_EAGER;
+  } else {
+    fprintf(stderr, "*lev: unknown LEV_SLAB_PREFILL, using lazy\n");
+    slab_prefill = LEV_SLAB_PREFILL_LAZY;
+  }
+
+  for (i = 0; i < SLAB_CLASS_COUNT; i++) {
+    _lev_slab_fill(&slab_classes[i], slab_classes[i].prefill);
+  }
 }
 
-MemBlock *lev_slab_getBlock(size_t size) {
-  lev_slab_allocator_t* allocator;
+int lev_slab_prefill_mode() {
+  return slab_prefill;
+}
+
+/*
+  allocate up to budget blocks towards each class's prefill count, never
+  beyond the (decaying) pool target. returns 0 once every class is warm,
+  so an idle callback knows when to stop.
+*/
+int lev_slab_warm(int budget) {
+  lev_slab_allocator_t *allocator;
+  size_t want;
+  MemBlock *mb;
+  int pending = 0;
+  int i;
+
+  for (i = 0; i < SLAB_CLASS_COUNT; i++) {
+    allocator = &slab_classes[i];
+    want = (size_t)MIN(allocator->prefill, allocator->pool_target);
+
+    while (budget > 0 && allocator->stats.live + allocator->pool_count < want) {
+      mb = _lev_slab_new_block(allocator);
+      if (!mb) {
+        return 0; /* out of memory; stop warming */
+      }
+      _lev_slab_push(allocator, mb);
+      budget--;
+    }
+    if (allocator->stats.live + allocator->pool_count < want) {
+      pending = 1;
+    }
+  }
+
+  return pending;
+}
+
+void lev_slab_configure(double decay) {
+  if (decay >= 0 && decay <= 1) {
+    slab_decay = decay;
+  }
+}
+
+/*
+  called once per idle period: fold the period's high-water mark into the
+  decayed peak and hand pooled blocks back to the OS for classes that
+  were not used at all during the period.
+*/
+void lev_slab_tick() {
+  lev_slab_allocator_t *allocator;
+  double decayed;
+  int i;
+
+  for (i = 0; i < SLAB_CLASS_COUNT; i++) {
+    allocator = &slab_classes[i];
+
+    decayed = allocator->peak * slab_decay;
+    _lev_slab_set_peak(allocator, MAX((double)allocator->window_peak, decayed));
+
+    if (!allocator->window_gets) {
+      _lev_slab_trim(allocator, allocator->pool_target);
+    }
+
+    allocator->window_peak = allocator->stats.live;
+    allocator->window_gets = 0;
+  }
+
+  if (!slab_large.window_gets) {
+    _lev_slab_large_trim();
+  }
+  slab_large.window_peak = slab_large.stats.live;
+  slab_large.window_gets = 0;
+}
+
+/* give every pooled block back right now */
+void lev_slab_trim() {
+  lev_slab_allocator_t *allocator;
+  int i;
+
+  for (i = 0; i < SLAB_CLASS_COUNT; i++) {
+    allocator = &slab_classes[i];
+    _lev_slab_trim(allocator, 0);
+    _lev_slab_set_peak(allocator, allocator->stats.live);
+  }
+
+  _lev_slab_large_trim();
+}
+
+size_t lev_slab_largest_class() {
+  if (!SLAB_CLASS_COUNT) {
+    return 0;
+  }
+  return slab_classes[SLAB_CLASS_COUNT - 1].blocksize;
+}
+
+static MemBlock *_lev_slab_getBlock(size_t size) {
+  lev_slab_allocator_t* allocator = NULL;
   MemBlock *block;
-  int blocksize;
-
-  if (size <= 1024) {
-    allocator = (lev_slab_allocator_t*)&mem_1k;
-    blocksize = 1024;
-  } else if (size <= 8*1024) {
-    allocator = (lev_slab_allocator_t*)&mem_8k;
-    blocksize = 8*1024;
-  } else if (size <= 16*1024) {
-    allocator = (lev_slab_allocator_t*)&mem_16k;
-    blocksize = 16*1024;
-  } else if (size <= 64*1024) {
-    allocator = (lev_slab_allocator_t*)&mem_64k;
-    blocksize = 64*1024;
-  } else if (size <= 1024*1024) {
-    allocator = (lev_slab_allocator_t*)&mem_1024k;
-    blocksize = 1024*1024;
-  } else {
-    return NULL;
+  int i;
+
+  _lev_slab_histogram_add(size);
+
+  for (i = 0; i < SLAB_CLASS_COUNT; i++) {
+    if (size <= slab_classes[i].blocksize) {
+      allocator = &slab_classes[i];
+      break;
+    }
+  }
+
+  if (!allocator) {
+    return _lev_slab_large_get(size);
   }
 
-  if (allocator->pool_count) {
-    block = allocator->pool[--allocator->pool_count];
-    /*printf("BLOCK TAKEN FROM POOL %d\n", blocksize);*/
+  if (allocator->pool) {
+    block = _lev_slab_pop(allocator);
+    allocator->stats.hits++;
+    /*printf("BLOCK TAKEN FROM POOL %lu\n", allocator->blocksize);*/
   } else {
-    /*printf("BLOCK TAKEN FROM MALLOC %d\n", blocksize);*/
-    block = (MemBlock *)malloc(sizeof(MemBlock) + blocksize);
+    /*printf("BLOCK TAKEN FROM MALLOC %lu\n", allocator->blocksize);*/
+    block = _lev_slab_new_block(allocator);
+    if (!block) {
+      return NULL;
+    }
+    allocator->stats.misses++;
+  }
+
+  allocator->window_gets++;
+  allocator->stats.requested_bytes += size;
+  allocator->stats.served_bytes += allocator->blocksize;
+  allocator->stats.live++;
+  allocator->stats.live_bytes += allocator->blocksize;
+  if (allocator->stats.live > allocator->stats.high_water) {
+    allocator->stats.high_water = allocator->stats.live;
+  }
+  if (allocator->stats.live > allocator->window_peak) {
+    allocator->window_peak = allocator->stats.live;
+  }
+  if (allocator->stats.live > allocator->peak) { /* grow with the burst */
+    _lev_slab_set_peak(allocator, allocator->stats.live);
   }
 
-  /*printf("[%p] lev_slab_getBlock(size=%d)\n", block, blocksize);*/
+  /*printf("[%p] lev_slab_getBlock(size=%lu)\n", block, allocator->blocksize);*/
   block->allocator = allocator;
+  block->next = NULL;
   block->refcount = 0;
-  block->size = blocksize;
+  block->size = allocator->blocksize;
   block->nbytes = 0;
+  block->sliced = 0;
+  return block;
+}
+
+#ifdef LEV_SLAB_DEBUG
+MemBlock *lev_slab_getBlockAt(size_t size, const char *file, int line) {
+  MemBlock *block = _lev_slab_getBlock(size);
+  if (block) {
+    _lev_slab_arm(block);
+    _lev_slab_track(block, file, line);
+  }
   return block;
 }
+#else
+MemBlock *lev_slab_getBlock(size_t size) {
+  return _lev_slab_getBlock(size);
+}
+#endif
 
 int lev_slab_incRef(MemBlock *block) {
+#ifdef LEV_SLAB_DEBUG
+  _lev_slab_check(block);
+#endif
   block->refcount++;
   /*printf("[%p] lev_slab_incRef(r=%d, p=%p(%lu))\n", block, block->refcount, block->allocator, block->size);*/
   return block->refcount;
@@ -113,19 +824,82 @@ int lev_slab_incRef(MemBlock *block) {
 int lev_slab_decRefCount(MemBlock *block, int count) {
   if (!block) return 0;
 
+#ifdef LEV_SLAB_DEBUG
+  _lev_slab_check(block);
+  if (block->refcount <= 0) {
+    fprintf(stderr, "*lev: refcount underflow (%d) on slab block %p allocated at %s:%d\n",
+      block->refcount, block, block->file, block->line);
+    abort();
+  }
+#endif
+
   block->refcount--;
 
   /*printf("[%p] lev_slab_decRef(r=%d, p=%p(%lu))\n", block, block->refcount, block->allocator, block->size);*/
   
   if (block->refcount == 0) {/* return block to pool */
-    if (block->allocator->pool_count < block->allocator->pool_min) {
-      block->allocator->pool[block->allocator->pool_count++] = block;
-      /*printf("BLOCK PUT ON SHELF %lu -> %d\n", block->size, block->allocator->pool_count); */
+    lev_slab_allocator_t *allocator = block->allocator;
+#ifdef LEV_SLAB_DEBUG
+    _lev_slab_untrack(block);
+#endif
+    if (block->flags & MEMBLOCK_LARGE) {
+      _lev_slab_large_put(block);
+      return 0;
+    }
+    allocator->stats.live--;
+    allocator->stats.live_bytes -= allocator->blocksize;
+    if (allocator->stats.live + allocator->pool_count < (size_t)allocator->pool_target) {
+      _lev_slab_push(allocator, block);
+      /*printf("BLOCK PUT ON SHELF %lu -> %d\n", block->size, allocator->pool_count); */
     } else {
       /*printf("FREEFREEFREEFREEFREEFREEFREEFREEFREEFREEFREEFREEFREE\n");*/
-      free(block); 
+      allocator->stats.frees++;
+      _lev_slab_release_block(allocator, block);
     }
     return 0;
   }
   return block->refcount;
 }
+
+/* X:S retention */
+
+static lev_slab_retention_t slab_retention;
+
+/*
+  delta bytes of block became (delta > 0) or stopped being (delta < 0)
+  visible through a lev.buffer. a block is retained from its first
+  sliced byte until its last one goes away.
+*/
+void lev_slab_slice(MemBlock *block, long delta) {
+  if (!block->sliced && delta > 0) {
+    slab_retention.blocks++;
+    slab_retention.retained_bytes += block->size;
+  }
+  block->sliced += (size_t)delta;
+  slab_retention.sliced_bytes += (size_t)delta;
+  if (!block->sliced && delta < 0) {
+    slab_retention.blocks--;
+    slab_retention.retained_bytes -= block->size;
+  }
+}
+
+lev_slab_retention_t *lev_slab_retention() {
+  return &slab_retention;
+}
+
+/* X:E retention */
+
+/* the large-object tier is reported as the last class */
+int lev_slab_class_count() {
+  return SLAB_CLASS_COUNT + 1;
+}
+
+lev_slab_allocator_t *lev_slab_class(int index) {
+  if (index == SLAB_CLASS_COUNT) {
+    return &slab_large;
+  }
+  if (index < 0 || index > SLAB_CLASS_COUNT) {
+    return NULL;
+  }
+  return &slab_classes[index];
+}
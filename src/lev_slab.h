@@ -21,7 +21,32 @@
 #include "lua.h"
 #include "uv.h"
 
-#define SLAB_MAXFREELIST 1024 * 16 * 2
+/* default tuning for the adaptive pools; see lev_slab_configure() */
+#define SLAB_DEFAULT_IDLE_MS 5000 /* how long a class must sit unused before we trim it */
+#define SLAB_DEFAULT_DECAY   0.5  /* per idle period decay applied to the pool high-water mark */
+
+/* where fresh blocks come from; chosen once at startup via LEV_SLAB_BACKEND */
+#define LEV_SLAB_BACKEND_MALLOC 0 /* one malloc() per block */
+#define LEV_SLAB_BACKEND_ARENA  1 /* blocks carved from large (huge page) mmap arenas */
+
+/* MemBlock flags */
+#define MEMBLOCK_ARENA 1 /* block lives inside an arena and must never be free()'d */
+#define MEMBLOCK_LARGE 2 /* block is its own mmap extent (larger than the biggest class) */
+
+#define SLAB_LARGE_CACHE 4 /* recently freed large extents kept around for reuse */
+
+/* size classes; override with LEV_SLAB_CLASSES or `lev -s` using the same syntax */
+#define SLAB_MAX_CLASSES 32
+#define SLAB_DEFAULT_CLASSES "1k:1024,2k,4k,8k:512,16k:8,32k,64k:8,128k,256k,512k,1024k"
+
+/* how the per class prefill counts are honoured; chosen via LEV_SLAB_PREFILL */
+#define LEV_SLAB_PREFILL_LAZY  0 /* nothing up front; pools fill on first demand */
+#define LEV_SLAB_PREFILL_IDLE  1 /* warmed a few blocks at a time from an idle callback */
+#define LEV_SLAB_PREFILL_EAGER 2 /* everything allocated before the first script runs */
+
+#define SLAB_WARM_BATCH 32 /* blocks allocated per idle callback while warming */
+
+#define SLAB_HISTOGRAM_BUCKETS 32 /* power of two buckets of requested sizes */
 
 /* --[  LEVSTRUCT_REF_ ]-- */
 /* == refCount == */
@@ -48,30 +73,108 @@ typedef struct _MemBlock MemBlock;
 
 struct _MemBlock {
   lev_slab_allocator_t *allocator;
+  MemBlock *next;  /* free list link while the block sits in the pool */
   int refcount;  /* Number of references to this block */
+  int flags;     /* MEMBLOCK_* */
   size_t size;   /* Size of the datablock */
   size_t nbytes; /* Number of bytes actually in buffer */
+  size_t sliced; /* bytes visible through live lev.buffer objects; see lev_slab_slice() */
+#ifdef LEV_SLAB_DEBUG
+  const char *file;   /* allocation site */
+  int line;
+  MemBlock *live_prev; /* every live block, for the leak report */
+  MemBlock *live_next;
+  unsigned int canary; /* SLAB_CANARY; another one follows bytes[size] */
+#endif
   unsigned char bytes[0];
 };
 
+#ifdef LEV_SLAB_DEBUG
+#define SLAB_CANARY 0x5ab1ca9e
+#define SLAB_POISON 0xdb       /* fill byte for blocks sitting in a pool */
+#define SLAB_TAIL   sizeof(unsigned int)
+#else
+#define SLAB_TAIL   0
+#endif
+
+typedef struct _lev_slab_stats {
+  size_t hits;       /* blocks served from the pool */
+  size_t misses;     /* blocks that fell back to malloc */
+  size_t frees;      /* blocks free'd because the pool was already at pool_target */
+  size_t live;       /* blocks currently handed out */
+  size_t live_bytes; /* bytes currently handed out */
+  size_t high_water; /* most blocks ever handed out at the same time */
+  size_t trimmed;    /* pooled blocks given back to the OS after an idle period */
+  size_t mapped_bytes; /* arena backend / large tier: bytes mmap'd for this class */
+  size_t requested_bytes; /* bytes asked for, summed over every block handed out */
+  size_t served_bytes;    /* block bytes handed out for those requests */
+} lev_slab_stats_t;
+
+/* what lev.buffer slices keep alive, over all blocks */
+typedef struct _lev_slab_retention {
+  size_t blocks;          /* blocks with at least one live lev.buffer on them */
+  size_t retained_bytes;  /* the size of those blocks */
+  size_t sliced_bytes;    /* bytes visible through the buffers (overlaps count twice) */
+  size_t compactions;     /* slices copied into a right-sized block */
+  size_t compacted_bytes; /* bytes copied doing so */
+} lev_slab_retention_t;
+
 struct _lev_slab_allocator {
-  MemBlock *pool[SLAB_MAXFREELIST];
+  char name[24]; /* fits any size_t in decimal plus the k/m suffix */
+  size_t blocksize;
+  int prefill;         /* blocks to seed the pool with at startup */
+  MemBlock *pool;      /* singly linked free list */
   int pool_count;
-  int pool_min;
+  int pool_target;     /* live + pooled blocks we are willing to hold on to */
+  double peak;         /* decayed high-water mark of live blocks */
+  size_t window_peak;  /* high-water mark of live blocks in the current period */
+  size_t window_gets;  /* blocks handed out in the current period */
+  MemBlock *released;  /* arena blocks whose pages were handed back to the OS */
+  int released_count;
+  unsigned char *arena_cur; /* bump pointer into the current arena */
+  unsigned char *arena_end;
+  lev_slab_stats_t stats;
 };
 
+/* the lev.buffer userdata; plain userdata, see lev_buffer_alloc() */
 typedef struct _MemSlice {
-  LEVBASE_REF_FIELDS
   MemBlock *mb;         /* our MemBlock */
   unsigned char *slice; /* begining of slice */
   size_t until;         /* range of how far we have sliced */
+  int pinned;           /* ptr() gave the address out: the bytes must not move */
 } MemSlice;
 
+int lev_slab_set_backend(const char *name);
+int lev_slab_set_classes(const char *spec);
+const char *lev_slab_backend_name();
 void lev_slab_fill();
+int lev_slab_prefill_mode();
+int lev_slab_warm(int budget);
+#ifdef LEV_SLAB_DEBUG
+MemBlock *lev_slab_getBlockAt(size_t size, const char *file, int line);
+#define lev_slab_getBlock(size) lev_slab_getBlockAt(size, __FILE__, __LINE__)
+#else
 MemBlock *lev_slab_getBlock(size_t size);
+#endif
+MemBlock *lev_slab_growBlock(MemBlock *block, size_t size);
+size_t lev_slab_largest_class();
 int lev_slab_incRef(MemBlock *block);
 int lev_slab_decRefCount(MemBlock *block, int count);
 #define lev_slab_decRef(block)   lev_slab_decRefCount(block, 1)
 
+/* adaptive pool sizing */
+void lev_slab_configure(double decay);
+void lev_slab_tick();
+void lev_slab_trim();
+
+/* slice retention */
+void lev_slab_slice(MemBlock *block, long delta);
+lev_slab_retention_t *lev_slab_retention();
+
+/* introspection */
+int lev_slab_class_count();
+lev_slab_allocator_t *lev_slab_class(int index);
+size_t lev_slab_histogram(int bucket);
+
 #endif
 
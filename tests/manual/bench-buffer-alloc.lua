@@ -0,0 +1,55 @@
+--[[
+
+Copyright 2012 The lev Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+-- Lua heap growth and GC time per lev.buffer created.
+-- usage: lev tests/manual/bench-buffer-alloc.lua [count]
+
+local lev = require('lev')
+local string = require('string')
+local os = require('os')
+
+local count = tonumber(arg and arg[1]) or 100000
+
+local function bench(name, make)
+  local keep = {}
+
+  collectgarbage()
+  collectgarbage('stop')
+  local before = collectgarbage('count')
+  local t0 = os.clock()
+  for i = 1, count do
+    keep[i] = make(i)
+  end
+  local t1 = os.clock()
+  local grown = collectgarbage('count') - before
+
+  keep = nil
+  local t2 = os.clock()
+  collectgarbage()
+  local t3 = os.clock()
+  collectgarbage('restart')
+
+  print(string.format('%-8s %8d objects  %7.1f bytes/object  create %6.3fs  gc %6.3fs'
+    , name, count, grown * 1024 / count, t1 - t0, t3 - t2))
+end
+
+local source = Buffer:new(4096)
+
+bench('new', function(i) return Buffer:new(64) end)
+bench('slice', function(i) return source:slice(1 + i % 4000, 64) end)
+bench('string', function(i) return Buffer:new('GET / HTTP/1.1\r\n') end)
@@ -0,0 +1,63 @@
+--[[
+
+Copyright 2012 The lev Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+-- hex and base64 throughput per codec kernel, plus a string.format/gsub
+-- hex encoder as the pure Lua baseline.
+-- usage: lev tests/manual/bench-buffer-codec.lua [iterations]
+
+local lev = require('lev')
+local string = require('string')
+local os = require('os')
+local table = require('table')
+
+local iterations = tonumber(arg and arg[1]) or 2000
+
+local chunk = {}
+for i = 0, 255 do
+  chunk[#chunk + 1] = string.char(i)
+end
+local payload = Buffer:new(string.rep(table.concat(chunk), 64)) -- 16k
+local hex = payload:toHex()
+local b64 = payload:toBase64()
+
+local function bench(kernel, name, fn)
+  local t0 = os.clock()
+  for i = 1, iterations do
+    fn()
+  end
+  local elapsed = os.clock() - t0
+  print(string.format('%-8s %-11s %8.0f MB/s', kernel, name, #payload * iterations / elapsed / 1e6))
+end
+
+local raw = payload:toString()
+bench('lua', 'toHex', function()
+  return (raw:gsub('.', function(c) return string.format('%02x', c:byte()) end))
+end)
+
+local default = Buffer.codecKernel()
+
+for _, kernel in ipairs({ 'generic', 'sse2', 'ssse3' }) do
+  if pcall(Buffer.codecKernel, kernel) then
+    bench(kernel, 'toHex', function() return payload:toHex() end)
+    bench(kernel, 'fromHex', function() return Buffer.fromHex(hex) end)
+    bench(kernel, 'toBase64', function() return payload:toBase64() end)
+    bench(kernel, 'fromBase64', function() return Buffer.fromBase64(b64) end)
+  end
+end
+
+Buffer.codecKernel(default)
@@ -0,0 +1,60 @@
+--[[
+
+Copyright 2012 The lev Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+-- byte-at-a-time scan of a buffer: readUInt8 (a C call per byte, no JIT
+-- trace) against a bufferffi pointer.
+-- usage: lev tests/manual/bench-buffer-ffi.lua [iterations]
+
+local string = require('string')
+local os = require('os')
+local bufferffi = require('bufferffi')
+
+local iterations = tonumber(arg and arg[1]) or 200
+
+local payload = Buffer:new(string.rep('GET / HTTP/1.1\r\nHost: lev\r\n\r\n', 2048))
+
+local function bench(name, fn)
+  local t0 = os.clock()
+  local lines
+  for i = 1, iterations do
+    lines = fn()
+  end
+  local elapsed = os.clock() - t0
+  print(string.format('%-10s %8.0f MB/s (%d lines)', name, #payload * iterations / elapsed / 1e6, lines))
+end
+
+bench('readUInt8', function()
+  local lines = 0
+  for i = 1, #payload do
+    if payload:readUInt8(i) == 10 then
+      lines = lines + 1
+    end
+  end
+  return lines
+end)
+
+bench('ffi', function()
+  local p, len = bufferffi.ptr(payload)
+  local lines = 0
+  for i = 0, len - 1 do
+    if p[i] == 10 then
+      lines = lines + 1
+    end
+  end
+  return lines
+end)
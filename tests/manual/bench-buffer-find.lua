@@ -0,0 +1,61 @@
+--[[
+
+Copyright 2012 The lev Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+-- buffer:find throughput per search kernel; "generic" is the old memmem path.
+-- usage: lev tests/manual/bench-buffer-find.lua [iterations]
+
+local lev = require('lev')
+local string = require('string')
+local os = require('os')
+local table = require('table')
+
+local iterations = tonumber(arg and arg[1]) or 20000
+
+-- a 16k request whose header block ends near the end; plenty of lone \r\n
+local header = {}
+for i = 1, 400 do
+  header[#header + 1] = 'X-Header-' .. i .. ': some value\r\n'
+end
+local request = 'POST /upload HTTP/1.1\r\n' .. table.concat(header)
+request = request .. string.rep('a', 16384 - #request - 4) .. '\r\n\r\n'
+local buf = Buffer:new(request)
+
+local cases = {
+   { 'crlfcrlf', '\r\n\r\n' }
+  ,{ 'needle',   Buffer.needle('\r\n\r\n') }
+  ,{ 'boundary', '--------------------------boundary' }
+  ,{ 'multi',    Buffer.needle({ '\r\n\r\n', '--boundary' }) }
+}
+
+local default = Buffer.searchKernel()
+
+for _, kernel in ipairs({ 'generic', 'sse2', 'avx2' }) do
+  if pcall(Buffer.searchKernel, kernel) then
+    for _, case in ipairs(cases) do
+      local name, needle = case[1], case[2]
+      local t0 = os.clock()
+      for i = 1, iterations do
+        buf:find(needle)
+      end
+      local elapsed = os.clock() - t0
+      print(string.format('%-8s %-9s %8.0f MB/s', kernel, name, #buf * iterations / elapsed / 1e6))
+    end
+  end
+end
+
+Buffer.searchKernel(default)
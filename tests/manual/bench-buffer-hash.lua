@@ -0,0 +1,50 @@
+--[[
+
+Copyright 2012 The lev Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+-- checksum and hash throughput over a 64k buffer, per crc32c kernel.
+-- usage: lev tests/manual/bench-buffer-hash.lua [iterations]
+
+local string = require('string')
+local os = require('os')
+
+local iterations = tonumber(arg and arg[1]) or 2000
+
+local payload = Buffer:new(string.rep('lev checksums every ipc message. ', 2048)) -- 64k
+
+local function bench(kernel, name, fn)
+  local t0 = os.clock()
+  for i = 1, iterations do
+    fn()
+  end
+  local elapsed = os.clock() - t0
+  print(string.format('%-8s %-8s %8.0f MB/s', kernel, name, #payload * iterations / elapsed / 1e6))
+end
+
+bench('zlib', 'crc32', function() return payload:crc32() end)
+bench('zlib', 'adler32', function() return payload:adler32() end)
+bench('-', 'xxh64', function() return payload:xxh64() end)
+
+local default = Buffer.hashKernel()
+
+for _, kernel in ipairs({ 'generic', 'sse4.2' }) do
+  if pcall(Buffer.hashKernel, kernel) then
+    bench(kernel, 'crc32c', function() return payload:crc32c() end)
+  end
+end
+
+Buffer.hashKernel(default)
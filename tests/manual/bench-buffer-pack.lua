@@ -0,0 +1,52 @@
+--[[
+
+Copyright 2012 The lev Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+-- decoding a 20 field binary header: one read* call per field against a
+-- single unpack() with a format string and with a compiled format.
+-- usage: lev tests/manual/bench-buffer-pack.lua [iterations]
+
+local lev = require('lev')
+local string = require('string')
+local os = require('os')
+
+local iterations = tonumber(arg and arg[1]) or 1000000
+
+local FORMAT = '>I4 I4 I2 I2 I4 I4 I2 I2 B B B B I4 I4 I2 I2 I4 I4 I2 I2'
+local compiled = Buffer.format(FORMAT)
+local header = Buffer:new(compiled:size())
+header:fill(7)
+
+local function bench(name, decode)
+  local t0 = os.clock()
+  for i = 1, iterations do
+    decode()
+  end
+  local elapsed = os.clock() - t0
+  print(string.format('%-9s %10.0f headers/sec', name, iterations / elapsed))
+end
+
+bench('read*', function()
+  local h = header
+  return h:readUInt32BE(1), h:readUInt32BE(5), h:readUInt16BE(9), h:readUInt16BE(11)
+    , h:readUInt32BE(13), h:readUInt32BE(17), h:readUInt16BE(21), h:readUInt16BE(23)
+    , h:readUInt8(25), h:readUInt8(26), h:readUInt8(27), h:readUInt8(28)
+    , h:readUInt32BE(29), h:readUInt32BE(33), h:readUInt16BE(37), h:readUInt16BE(39)
+    , h:readUInt32BE(41), h:readUInt32BE(45), h:readUInt16BE(49), h:readUInt16BE(51)
+end)
+bench('string', function() return header:unpack(FORMAT) end)
+bench('compiled', function() return header:unpack(compiled) end)
@@ -0,0 +1,89 @@
+--[[
+
+Copyright 2012 The lev Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+-- C -> Lua callback dispatches per second: zero-timeout timers and a
+-- loopback tcp ping-pong. run on the old and new build to compare.
+-- usage: lev tests/manual/bench-callback-dispatch.lua [seconds]
+
+local lev = require('lev')
+local string = require('string')
+local os = require('os')
+
+local seconds = tonumber(arg and arg[1]) or 3
+local PORT = 10083
+
+local function report(name, events, elapsed)
+  print(string.format('%-8s %10d events  %10.0f events/sec', name, events, events / elapsed))
+end
+
+local function bench_tcp()
+  local PING = Buffer:new('ping')
+  local events = 0
+  local running = true
+
+  local server = lev.tcp.new()
+  server:bind('127.0.0.1', PORT)
+  server:listen(function(s, err)
+    local peer = s:accept()
+    peer:read_start(function(c, nread, buf)
+      events = events + 1
+      c:write(buf)
+    end)
+  end)
+
+  local client = lev.tcp.new()
+  client:connect('127.0.0.1', PORT, function()
+    local stop = lev.timer.new()
+    stop:start(function()
+      running = false
+      report('tcp', events, seconds)
+      stop:close()
+      client:close()
+      server:close()
+    end, seconds * 1000, 0)
+
+    client:read_start(function(c, nread, buf)
+      events = events + 1
+      if running then
+        c:write(PING)
+      end
+    end)
+    client:write(PING)
+  end)
+end
+
+local function bench_timer()
+  local events = 0
+  local started = os.clock() -- the loop is cpu bound, so cpu time ~ wall time
+  local timer = lev.timer.new()
+
+  local function tick()
+    events = events + 1
+    if events % 1000 == 0 and os.clock() - started >= seconds then
+      report('timer', events, os.clock() - started)
+      timer:close()
+      bench_tcp()
+      return
+    end
+    timer:start(tick, 0, 0)
+  end
+
+  timer:start(tick, 0, 0)
+end
+
+bench_timer()
@@ -16,6 +16,9 @@ limitations under the License.
 
 --]]
 
+local string = require('string')
+local math = require('math')
+
 local exports = {}
 
 local OUTSIDE_BUFFER = Buffer.new("HELLO, SIR!")
@@ -195,6 +198,303 @@ exports['lev.buffer:\tBuffer:find'] = function(test)
    test.done()
 end
 
+exports['lev.buffer:\tBuffer:find with init and needles'] = function(test)
+   local buf = Buffer:new('GET / HTTP/1.1\r\nHost: x\r\n\r\nbody')
+
+   test.equal(buf:find('\r\n'), 15)
+   test.equal(buf:find('\r\n', 16), 24)
+   test.is_nil(buf:find('\r\n', 100))
+
+   local crlf2 = Buffer.needle('\r\n\r\n')
+   test.equal(buf:find(crlf2), 24)
+   test.equal(buf:upUntil(crlf2), 'GET / HTTP/1.1\r\nHost: x')
+
+   local any = Buffer.needle({ 'Host:', 'HTTP/' })
+   local pos, which = buf:find(any)
+   test.equal(pos, 7)
+   test.equal(which, 2)
+   pos, which = buf:find(any, 8)
+   test.equal(pos, 17)
+   test.equal(which, 1)
+
+   -- every kernel the CPU supports finds the same thing
+   local kernel = Buffer.searchKernel()
+   local long = Buffer:new(string.rep('-', 1000) .. '--boundary--')
+   for _, name in ipairs({ 'generic', 'sse2', 'avx2' }) do
+      if pcall(Buffer.searchKernel, name) then
+         test.equal(long:find('--boundary--'), 1001)
+         test.equal(buf:find(any), 7)
+      end
+   end
+   Buffer.searchKernel(kernel)
+
+   test.done()
+end
+
+exports['lev.buffer:\tBuffer:pack/unpack'] = function(test)
+   local buf = Buffer:new(64)
+
+   local pos = buf:pack('>I2 <i4 B x c4 s1 z', 1, 0x1234, -2, 255, 'ab', 'hello', 'hi')
+   test.equal(pos, 22)
+   test.equal(buf:readUInt16BE(1), 0x1234)
+   test.equal(buf:readInt32LE(3), -2)
+   test.equal(buf:toString(9, 4), 'ab\0\0')
+
+   local a, b, c, d, e, f, next = buf:unpack('>I2 <i4 B x c4 s1 z')
+   test.equal(a, 0x1234)
+   test.equal(b, -2)
+   test.equal(c, 255)
+   test.equal(d, 'ab\0\0')
+   test.equal(e, 'hello')
+   test.equal(f, 'hi')
+   test.equal(next, 22)
+
+   -- 64 bit ints, floats and varints, at an offset
+   local fmt = Buffer.format('<l >d f v w')
+   test.is_nil(fmt:size())
+   test.equal(Buffer.format('>I4 h d'):size(), 14)
+   pos = buf:pack(fmt, 30, -1, 0.25, 1.5, 300, -3)
+   test.equal(pos, 30 + 8 + 8 + 4 + 2 + 1)
+   local l, dd, ff, v, w = buf:unpack(fmt, 30)
+   test.equal(l, -1)
+   test.equal(dd, 0.25)
+   test.equal(ff, 1.5)
+   test.equal(v, 300)
+   test.equal(w, -3)
+   test.equal(buf:readUInt8(30 + 8 + 8 + 4), 0xac)
+
+   -- short data is nil rather than an error, bad input is an error
+   local short = Buffer:new('\0\5abc')
+   test.is_nil(short:unpack('>s2'))
+   test.is_nil(short:unpack('>I4', 4))
+   test.throws(buf.pack, buf, 'I4', 62, 1)
+   test.throws(buf.pack, buf, 'c2', 1, 'abc')
+   test.throws(Buffer.format, 'i3')
+   test.throws(Buffer.format, 'q')
+
+   test.done()
+end
+
+exports['lev.buffer:\tBuffer hex and base64'] = function(test)
+   local buf = Buffer:new('\0\1\127\128\254\255')
+
+   test.equal(buf:toHex():toString(), '00017f80feff')
+   test.equal(buf:toHex(true):toString(), '00017F80FEFF')
+   test.equal(Buffer.fromHex('00017F80feff'), buf)
+   test.is_nil(Buffer.fromHex('0g'))
+   test.is_nil(Buffer.fromHex('abc'))
+
+   test.equal(Buffer:new('hello'):toBase64():toString(), 'aGVsbG8=')
+   test.equal(Buffer:new('\251\255'):toBase64():toString(), '+/8=')
+   test.equal(Buffer:new('\251\255'):toBase64(true):toString(), '-_8')
+   test.equal(Buffer.fromBase64('aGVsbG8='):toString(), 'hello')
+   test.equal(Buffer.fromBase64('aGVsbG8'):toString(), 'hello')
+   test.equal(Buffer.fromBase64('-_8', true), Buffer:new('\251\255'))
+   test.is_nil(Buffer.fromBase64('-_8'))
+   test.is_nil(Buffer.fromBase64('aGVsb'))
+   test.equal(#Buffer.fromBase64(''), 0)
+
+   -- into an existing buffer, from a string or a buffer
+   local out = Buffer:new(32)
+   local pos = out:writeHex('ab', 1)
+   test.equal(pos, 5)
+   pos = out:writeBase64(Buffer:new('hello'), pos)
+   test.equal(out:toString(1, pos - 1), '6162aGVsbG8=')
+   test.throws(out.writeHex, out, string.rep('x', 17), 1)
+
+   -- the websocket handshake example from RFC 6455
+   local key = Buffer.fromHex('b37a4f2cc0624f1690f64606cf385945b2bec4ea')
+   test.equal(key:toBase64():toString(), 's3pPLMBiTxaQ9kYGzzhZRbK+xOo=')
+
+   -- every kernel the CPU supports agrees, across the SIMD block sizes
+   local kernel = Buffer.codecKernel()
+   local long = Buffer:new(string.rep('\0\1\2lev\255', 50))
+   local hex, b64 = long:toHex():toString(), long:toBase64():toString()
+   for _, name in ipairs({ 'generic', 'sse2', 'ssse3' }) do
+      if pcall(Buffer.codecKernel, name) then
+         test.equal(long:toHex():toString(), hex)
+         test.equal(long:toBase64():toString(), b64)
+         test.equal(Buffer.fromHex(hex), long)
+         test.equal(Buffer.fromBase64(b64), long)
+      end
+   end
+   Buffer.codecKernel(kernel)
+
+   test.done()
+end
+
+exports['lev.buffer:\tBuffer:detach/compact'] = function(test)
+   local big = Buffer:new(string.rep('01234567', 1024)) -- a whole 8k block
+   local head = big:slice(1, 20)
+   local size, sliced = head:retention()
+   test.equal(size, 8192)
+   test.equal(sliced, 8192 + 20)
+
+   -- a detached copy only keeps its own bytes alive
+   local copy = head:detach()
+   test.equal(copy, head)
+   test.ok(copy:retention() < size)
+
+   -- still mostly visible through big: nothing to gain
+   test.equal(head:compact(), false)
+
+   big = nil
+   collectgarbage()
+   collectgarbage()
+
+   test.equal(head:compact(), true)
+   test.equal(head:toString(), '01234567012345670123')
+   test.ok(head:retention() < size)
+
+   local stats = lev.slab.retention()
+   test.ok(stats.compactions >= 1)
+   test.ok(stats.compacted_bytes >= 20)
+
+   test.done()
+end
+
+exports['lev.buffer:\tBuffer:ptr'] = function(test)
+   local buf = Buffer:new('lev buffer')
+   local p, len = buf:ptr()
+   test.equal(type(p), 'userdata')
+   test.equal(len, 10)
+
+   local ok, bufferffi = pcall(require, 'bufferffi')
+   if not ok then -- built without the FFI
+      return test.done()
+   end
+
+   local bytes, n = bufferffi.ptr(buf)
+   test.equal(n, 10)
+   test.equal(bytes[0], string.byte('l'))
+   bytes[0] = string.byte('L')
+   test.equal(buf:toString(), 'Lev buffer')
+
+   -- slices see the same memory at an offset
+   local tail = buf:slice(5)
+   local tail_bytes = bufferffi.pin(tail)
+   test.equal(tail_bytes, bytes + 4)
+   test.equal(tonumber(bufferffi.slice(tail).len), 6)
+
+   -- the pointer anchors its buffer, and takes it off the compaction list
+   lev.slab.configure({ compact = 64 })
+   local big = Buffer:new(16 * 1024)
+   local head = big:slice(1, 16)
+   big = nil
+   head:fill(7)
+   local tracked = lev.slab.retention().tracked
+   local hp = bufferffi.ptr(head)
+   test.equal(lev.slab.retention().tracked, tracked - 1)
+   head = nil
+   collectgarbage()
+   test.equal(lev.slab.compact(), 0)
+   test.equal(hp[15], 7)
+   lev.slab.configure({ compact = 0 })
+
+   -- a pinned buffer refuses to move: growing or compacting it is an error
+   local pinned = Buffer:new('pinned')
+   local pp = bufferffi.ptr(pinned)
+   test.throws(function() pinned[#pinned + 1] = 'grown' end)
+   test.throws(function() pinned:compact(true) end)
+   pinned[1] = 'P'
+   test.equal(pinned:toString(), 'Pinned')
+   test.equal(pp[0], string.byte('P'))
+
+   test.done()
+end
+
+exports['lev.buffer:\tBuffer checksums'] = function(test)
+   local buf = Buffer:new('123456789')
+
+   -- the usual check values
+   test.equal(buf:crc32(), 0xcbf43926)
+   test.equal(buf:crc32c(), 0xe3069283)
+   test.equal(buf:adler32(), 0x091e01de)
+   test.equal(Buffer:new(''):xxh64(), 'ef46db3751d8e999')
+   test.equal(Buffer:new('abc'):xxh64(), '44bc2cf5ad770999')
+
+   -- continuing from a previous value, and ranges
+   test.equal(buf:crc32(buf:crc32(0, 1, 4), 5), buf:crc32())
+   test.equal(buf:adler32(buf:adler32(1, 1, 4), 5), buf:adler32())
+   test.equal(Buffer:new('xabcx'):xxh64(0, 2, 3), '44bc2cf5ad770999')
+   test.throws(buf.crc32, buf, 0, 11)
+   test.throws(buf.crc32, buf, 0, 5, 6)
+
+   -- streaming over buffers and strings
+   local long = Buffer:new(string.rep('lev hashes ', 100))
+   for _, name in ipairs({ 'crc32', 'crc32c', 'adler32', 'xxh64' }) do
+      local hasher = Buffer.hasher(name)
+      for i = 1, #long, 37 do
+         hasher:update(long, i, math.min(37, #long - i + 1))
+      end
+      test.equal(hasher:digest(), long[name](long))
+      test.equal(Buffer.hasher(name):update(long:toString()):digest(), long[name](long))
+   end
+   test.throws(Buffer.hasher, 'md5')
+
+   -- every crc32c kernel the CPU supports agrees
+   local kernel = Buffer.hashKernel()
+   local crc = long:crc32c()
+   for _, name in ipairs({ 'generic', 'sse4.2' }) do
+      if pcall(Buffer.hashKernel, name) then
+         test.equal(long:crc32c(), crc)
+         test.equal(long:crc32c(0, 3, 501), long:slice(3, 501):crc32c())
+      end
+   end
+   Buffer.hashKernel(kernel)
+
+   test.done()
+end
+
+exports['lev.buffer:\tBuffer bulk operations'] = function(test)
+   local src = Buffer:new('0123456789')
+   local dst = Buffer:new(6)
+   dst:fill(0x2e)
+
+   test.equal(src:copy(dst, 2, 4, 6), 3)
+   test.equal(dst:toString(), '.345..')
+   test.equal(src:copy(dst, 4), 3) -- cut short at the end of dst
+   test.equal(dst:toString(), '.34012')
+   test.equal(src:copy(dst, 7), 0)
+   test.throws(src.copy, src, dst, 8)
+   test.throws(src.copy, src, dst, 1, 3, 11)
+   test.throws(src.copy, src, dst, 1, 5, 3)
+
+   -- within one buffer, overlapping both ways
+   local buf = Buffer:new('abcdefgh')
+   buf:copy(buf, 3, 1, 6)
+   test.equal(buf:toString(), 'ababcdef')
+   buf:copy(buf, 1, 3)
+   test.equal(buf:toString(), 'abcdefef')
+
+   test.equal(src:compare('0123456789'), 0)
+   test.equal(src:compare(Buffer:new('0124')), -1)
+   test.equal(src:compare('01234'), 1)
+   test.equal(Buffer:new(''):compare(''), 0)
+   test.equal(Buffer:new('\255'):compare('\1'), 1)
+
+   test.ok(src:equals('0123456789'))
+   test.ok(src:equals(Buffer:new('0123456789')))
+   test.not_ok(src:equals('012345678'))
+
+   test.ok(src:startsWith('012'))
+   test.ok(src:startsWith(''))
+   test.not_ok(src:startsWith('12'))
+   test.ok(src:endsWith(Buffer:new('789')))
+   test.not_ok(src:endsWith('0123456789a'))
+
+   local text = Buffer:new('a,b,,c,')
+   test.equal(text:lastIndexOf(','), 7)
+   test.equal(text:lastIndexOf(',', 6), 5)
+   test.equal(text:lastIndexOf(',,'), 4)
+   test.equal(text:lastIndexOf('a,', 1), 1)
+   test.is_nil(text:lastIndexOf('x'))
+   test.is_nil(text:lastIndexOf(''))
+   test.is_nil(text:lastIndexOf('a', 0))
+
+   test.done()
+end
+
 exports['lev.buffer:\tBuffer:upUntil'] = function(test)
    local buf = Buffer:new('abcdefghij')
 
@@ -0,0 +1,114 @@
+--[[
+
+Copyright 2012 The lev Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+local exports = {}
+
+exports['lev.bufferlist:\tappend/prepend'] = function(test)
+   local list = BufferList:new(Buffer:new('world'))
+   list:append('!', Buffer:new('\n'))
+   list:prepend('hello', ' ')
+
+   test.equal(#list, 13)
+   test.equal(list:count(), 5)
+   test.equal(list:toString(), 'hello world!\n')
+
+   list:append(list)
+   test.equal(list:toString(), 'hello world!\nhello world!\n')
+
+   test.done()
+end
+
+exports['lev.bufferlist:\tfind across chunks'] = function(test)
+   local list = BufferList:new('GET / HT', 'TP/1.1\r', '\n\r\n', 'body')
+
+   test.equal(list:find('HTTP'), 7)
+   test.equal(list:find('\r\n\r\n'), 15)
+   test.equal(list:find('\r\n', 16), 17)
+   test.equal(list:find(Buffer:new('body')), 19)
+   test.is_nil(list:find('nope'))
+   test.is_nil(list:find('body', 20))
+
+   test.done()
+end
+
+exports['lev.bufferlist:\tconsume/take'] = function(test)
+   local list = BufferList:new('abc', 'def', 'ghi')
+
+   list:consume(2)
+   test.equal(#list, 7)
+   test.equal(list:toString(), 'cdefghi')
+
+   local head = list:take(4) -- spans two chunks
+   test.equal(head:toString(), 'cdef')
+   test.equal(list:count(), 1)
+
+   local rest = list:take()
+   test.equal(rest:toString(), 'ghi')
+   test.equal(#list, 0)
+   test.is_nil(list:take())
+
+   test.done()
+end
+
+exports['lev.bufferlist:\tflatten'] = function(test)
+   local a = Buffer:new('foo')
+   local list = BufferList:new(a)
+
+   local flat = list:flatten()
+   test.equal(flat:toString(), 'foo')
+
+   list:append('bar', 'baz')
+   flat = list:flatten()
+   test.equal(flat:toString(), 'foobarbaz')
+   test.equal(list:count(), 1)
+
+   local buffers = BufferList:new('x', 'y'):buffers()
+   test.equal(#buffers, 2)
+   test.equal(buffers[2]:toString(), 'y')
+
+   test.done()
+end
+
+exports['lev.bufferlist:\ttcp write'] = function(test)
+   local PORT = 10084
+
+   local server = lev.tcp.new()
+   server:bind('127.0.0.1', PORT)
+   server:listen(function(s, err)
+      local client = s:accept()
+      local received = BufferList:new()
+      client:read_start(function(c, nread, buf)
+         received:append(buf)
+         if received:find('\r\n\r\n') then
+            test.equal(received:toString(), 'HEAD / HTTP/1.1\r\n\r\n')
+            c:close()
+            server:close()
+            test.done()
+         end
+      end)
+   end)
+
+   local client = lev.tcp.new()
+   client:connect('127.0.0.1', PORT, function()
+      local request = BufferList:new('HEAD', ' / ', Buffer:new('HTTP/1.1'), '\r\n\r\n')
+      client:write(request)
+      request:clear() -- the write keeps its own references
+   end)
+end
+
+return exports
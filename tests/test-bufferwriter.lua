@@ -0,0 +1,80 @@
+--[[
+
+Copyright 2012 The lev Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+local string = require('string')
+
+local exports = {}
+
+exports['lev.bufferwriter:\tappend'] = function(test)
+   local w = BufferWriter:new()
+   test.equal(#w, 0)
+
+   w:append('HTTP/1.1 ', 200, ' OK\r\n'):append(Buffer:new('Content-Length: '), 1.5)
+   test.equal(#w, 36)
+   test.equal(w:toString(), 'HTTP/1.1 200 OK\r\nContent-Length: 1.5')
+   test.throws(w.append, w, {})
+
+   test.done()
+end
+
+exports['lev.bufferwriter:\tappendf'] = function(test)
+   local w = BufferWriter:new()
+
+   w:appendf('%s=%d;%5.1f|%-4s|%04x %% %c', 'a\0b', 42, 3.14159, 'xy', 255, 65)
+   test.equal(w:toString(), 'a\0b=42;  3.1|xy  |00ff % A')
+   w:clear()
+   w:appendf('%s/%s', Buffer:new('buf'), 7)
+   test.equal(w:toString(), 'buf/7')
+
+   test.throws(w.appendf, w, '%d')
+   test.throws(w.appendf, w, '%q', 'x')
+
+   test.done()
+end
+
+exports['lev.bufferwriter:\tgrowth and finish'] = function(test)
+   local w = BufferWriter:new(16)
+   test.ok(w:capacity() >= 16)
+
+   local chunk = string.rep('0123456789', 10)
+   for i = 1, 1000 do
+      w:append(chunk)
+   end
+   test.equal(#w, 100000)
+   w:appendf('%300s', 'end')
+   test.equal(#w, 100300)
+
+   local buf = w:finish()
+   test.equal(#buf, 100300)
+   test.equal(buf:toString(99991, 10), '0123456789')
+   test.equal(buf:toString(100298), 'end')
+
+   -- the writer starts over and the finished buffer is left alone
+   test.equal(#w, 0)
+   w:append('next')
+   test.equal(w:finish():toString(), 'next')
+   test.equal(#buf, 100300)
+
+   test.equal(#BufferWriter:new():finish(), 0)
+   w:reserve(4096)
+   test.ok(w:capacity() >= 4096)
+
+   test.done()
+end
+
+return exports
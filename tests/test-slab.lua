@@ -0,0 +1,166 @@
+--[[
+
+Copyright 2012 The lev Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+local math = require('math')
+
+local exports = {}
+
+exports['lev.slab:\tclasses'] = function(test)
+   local classes = lev.slab.classes()
+   test.ok(#classes > 0)
+   test.equal(classes[1], '1k')
+
+   test.done()
+end
+
+exports['lev.slab:\tbackend'] = function(test)
+   local backend = lev.slab.backend()
+   test.ok(backend == 'malloc' or backend == 'arena' or backend == 'arena+hugetlb')
+
+   test.done()
+end
+
+exports['lev.slab:\tstats'] = function(test)
+   local before = lev.slab.stats()['1k']
+   test.is_number(before.hits)
+   test.is_number(before.misses)
+   test.is_number(before.frees)
+   test.is_number(before.high_water)
+   test.equal(before.blocksize, 1024)
+
+   local buf = Buffer:new(2000) -- too large for the shared 1k block
+   local after = lev.slab.stats()['2k']
+   test.ok(after.live >= 1)
+   test.ok(after.live_bytes >= after.live * 2048)
+   test.ok(after.high_water >= after.live)
+   test.ok(after.hits + after.misses >= 1)
+
+   buf = nil
+   collectgarbage()
+
+   test.done()
+end
+
+exports['lev.slab:\tlarge objects'] = function(test)
+   local size = 3 * 1024 * 1024
+   local big = Buffer:new(size)
+   test.equal(#big, size)
+
+   big[size] = 0x42
+   test.equal(big:readUInt8(size), 0x42)
+   test.equal(big:slice(size - 1):readUInt8(2), 0x42)
+
+   local large = lev.slab.stats()['large']
+   test.ok(large.live >= 1)
+   test.ok(large.live_bytes >= size)
+
+   test.done()
+end
+
+exports['lev.slab:\ttrim'] = function(test)
+   lev.slab.configure({ decay = 0.5 })
+   lev.slab.trim()
+
+   local stats = lev.slab.stats()
+   for name, class in pairs(stats) do
+      test.equal(class.pooled, 0)
+      test.ok(class.pool_target >= 0)
+   end
+
+   -- the pools grow back on demand
+   local buf = Buffer:new(4000)
+   test.ok(lev.slab.stats()['4k'].live >= 1)
+
+   test.done()
+end
+
+exports['lev.slab:\tfragmentation'] = function(test)
+   local before = lev.slab.stats()['16k']
+   local buf = Buffer:new(9 * 1024) -- 9k rounds up to a 16k block
+   local after = lev.slab.stats()['16k']
+
+   test.equal(after.requested_bytes - before.requested_bytes, 9 * 1024)
+   test.equal(after.served_bytes - before.served_bytes, 16 * 1024)
+   test.ok(after.fragmentation > 0 and after.fragmentation < 1)
+
+   local histogram = lev.slab.histogram()
+   test.ok(histogram[16 * 1024] >= 1)
+
+   test.done()
+end
+
+exports['lev.slab:\twarm'] = function(test)
+   lev.slab.trim()
+   local pending = lev.slab.warm(1)
+   test.equal(type(pending), 'boolean')
+
+   -- warming never goes past the pool target
+   for name, class in pairs(lev.slab.stats()) do
+      test.ok(class.pooled + class.live <= math.max(class.pool_target, class.live))
+   end
+
+   test.done()
+end
+
+exports['lev.slab:\tretention'] = function(test)
+   local retention = lev.slab.retention()
+   test.ok(retention.blocks >= 0)
+   test.ok(retention.retained_bytes >= 0)
+   test.equal(type(retention.waste), 'number')
+   test.equal(type(lev.slab.compact()), 'number')
+
+   -- tracking follows the sweep interval
+   lev.slab.configure({ compact = 0 })
+   test.equal(lev.slab.retention().tracked, 0)
+   lev.slab.configure({ compact = 64 })
+   local big = Buffer:new(16 * 1024)
+   local head = big:slice(1, 16)
+   test.ok(lev.slab.retention().tracked >= 1)
+   big, head = nil, nil
+   collectgarbage()
+   lev.slab.configure({ compact = 0 })
+
+   test.done()
+end
+
+exports['lev.slab:\tretention_across_growth'] = function(test)
+   -- b[i] = value past the end grows the buffer, possibly onto another
+   -- block; the sliced bytes have to move with it
+   local function check(size)
+      collectgarbage()
+      local before = lev.slab.retention()
+      local b = Buffer:new(size)
+      b[size] = "xy"
+      local grown = lev.slab.retention()
+      test.ok(#b > size)
+      test.equal(grown.sliced_bytes - before.sliced_bytes, #b)
+      b = nil
+      collectgarbage()
+      local after = lev.slab.retention()
+      test.equal(after.sliced_bytes, before.sliced_bytes)
+      test.equal(after.blocks, before.blocks)
+      test.equal(after.retained_bytes, before.retained_bytes)
+   end
+
+   check(4)
+   check(4 * 1024 * 1024) -- large object tier, grown in place by mremap
+
+   test.done()
+end
+
+return exports
@@ -16,6 +16,9 @@ limitations under the License.
 
 --]]
 
+local string = require('string')
+local table = require('table')
+
 local exports = {}
 
 exports['lev.tcp:\ttcp_echo_test'] = function(test)
@@ -67,4 +70,280 @@ exports['lev.tcp:\ttcp_echo_test'] = function(test)
   end)
 end
 
+exports['lev.tcp:\ttcp_read_sizing'] = function(test)
+  local PORT = 10083
+  local TOTAL = 1024 * 1024
+  local before = lev.reads.stats()
+
+  local server = lev.tcp.new()
+  server:bind("127.0.0.1", PORT)
+  server:listen(function(s, err)
+    test.is_nil(err)
+    local client = s:accept()
+    local received = 0
+    client:read_start(function(c, nread, buf)
+      test.equal(#buf, nread)
+      received = received + nread
+      if received == TOTAL then
+        -- a bulk sender pushes the read size up from the 8k default
+        local stats = c:read_stats()
+        test.equal(stats.bytes, TOTAL)
+        test.ok(stats.grows > 0)
+        test.ok(stats.size > 8192 and stats.size <= lev.reads.stats().max)
+
+        local after = lev.reads.stats()
+        test.ok(after.bytes - before.bytes >= TOTAL)
+        test.ok(after.reads - before.reads < TOTAL / 8192)
+        c:close()
+        server:close()
+        test.done()
+      end
+    end)
+  end)
+
+  local client = lev.tcp.new()
+  client:connect("127.0.0.1", PORT, function(...)
+    client:write(Buffer:new(TOTAL))
+    client:close()
+  end)
+end
+
+exports['lev.tcp:\ttcp_write_backpressure'] = function(test)
+  local PORT = 10084
+  local CHUNK = 64 * 1024
+
+  local server = lev.tcp.new()
+  server:bind("127.0.0.1", PORT)
+  server:listen(function(s, err)
+    test.is_nil(err)
+    local client = s:accept()
+    client:read_start(function(c, nread, buf)
+      if nread <= 0 then
+        c:close()
+      end
+    end)
+  end)
+
+  local client = lev.tcp.new()
+  test.equal(select(1, client:water_marks()), 64 * 1024)
+  test.equal(select(2, client:water_marks(4096)), 1024)
+  test.throws(client.water_marks, client, 4096, 4096)
+
+  client:connect("127.0.0.1", PORT, function(...)
+    -- whatever the kernel takes right away, a chunk over the high-water
+    -- mark is queued until its write completes
+    test.equal(client:write(Buffer:new(CHUNK)), false)
+    test.ok(client:write_queue_size() >= CHUNK)
+    client:on_drain(function(c)
+      test.ok(c:write_queue_size() <= 1024)
+      local stats = c:write_stats()
+      test.equal(stats.drains, 1)
+      test.ok(stats.peak >= CHUNK)
+      test.ok(stats.writes >= 1)
+      c:close()
+      server:close()
+      test.done()
+    end)
+  end)
+end
+
+exports['lev.tcp:\ttcp_write_strings'] = function(test)
+  local PORT = 10085
+  local parts = {}
+  for i = 1, 10 do
+    parts[i] = string.rep(string.char(64 + i), 1000 * i)
+  end
+  local expected = table.concat(parts)
+
+  local server = lev.tcp.new()
+  server:bind("127.0.0.1", PORT)
+  server:listen(function(s, err)
+    test.is_nil(err)
+    local client = s:accept()
+    local received = {}
+    client:read_start(function(c, nread, buf)
+      if nread > 0 then
+        received[#received + 1] = tostring(buf)
+        return
+      end
+      test.equal(table.concat(received), expected)
+      c:close()
+      server:close()
+      test.done()
+    end)
+  end)
+
+  local client = lev.tcp.new()
+  client:connect("127.0.0.1", PORT, function(...)
+    -- the strings are not copied: the bottled write has to keep them
+    -- alive on its own once parts is gone
+    client:bottle()
+    for i = 1, #parts do
+      client:write(string.rep(string.char(64 + i), 1000 * i))
+    end
+    parts = nil
+    collectgarbage()
+    client:write("", 1)
+    client:close()
+  end)
+end
+
+exports['lev.tcp:\ttcp_autocork'] = function(test)
+  local PORT = 10086
+  local client = lev.tcp.new()
+  local expected = {}
+
+  local server = lev.tcp.new()
+  server:bind("127.0.0.1", PORT)
+  server:listen(function(s, err)
+    test.is_nil(err)
+    local conn = s:accept()
+    local received = {}
+    conn:read_start(function(c, nread, buf)
+      if nread > 0 then
+        received[#received + 1] = tostring(buf)
+        return
+      end
+      test.equal(table.concat(received), table.concat(expected))
+      -- 40 writes and a table of 3, past the old 16 chunk limit, in one go
+      local stats = client:write_stats()
+      test.equal(stats.writes, 1)
+      c:close()
+      server:close()
+      test.done()
+    end)
+  end)
+
+  test.equal(client:autocork(), false)
+  test.equal(client:autocork(true), true)
+  test.throws(client.write, client, { "a", 1, {} })
+
+  client:connect("127.0.0.1", PORT, function(...)
+    for i = 1, 40 do
+      expected[#expected + 1] = "line " .. i .. "\r\n"
+      client:write(expected[#expected])
+    end
+    local tail = { "x", Buffer:new("y"), "z" }
+    for i = 1, #tail do
+      expected[#expected + 1] = tostring(tail[i])
+    end
+    client:write(tail)
+    test.equal(client:write_stats().writes, 0)
+    lev.timer.new():start(function(t)
+      t:close()
+      client:close()
+    end, 10, 0)
+  end)
+end
+
+exports['lev.tcp:\ttcp_reuseport'] = function(test)
+  local PORT = 10087
+  local CLIENTS = 8
+  local servers = {}
+  local accepted = 0
+
+  for i = 1, 2 do
+    local server = lev.tcp.new()
+    test.is_nil(server:bind("127.0.0.1", PORT, true))
+    server:listen(function(s, err)
+      test.is_nil(err)
+      local conn = s:accept()
+      conn:close()
+      accepted = accepted + 1
+      if accepted == CLIENTS then
+        -- the kernel picks the listener; together they saw every client
+        local total = 0
+        for j = 1, #servers do
+          local stats = servers[j]:accept_stats()
+          test.equal(stats.errors, 0)
+          total = total + stats.accepted
+          servers[j]:close()
+        end
+        test.equal(total, CLIENTS)
+        test.done()
+      end
+    end)
+    servers[i] = server
+  end
+
+  for i = 1, CLIENTS do
+    local client = lev.tcp.new()
+    client:connect("127.0.0.1", PORT, function(c)
+      c:close()
+    end)
+  end
+end
+
+exports['lev.tcp:\ttcp_batched_accept'] = function(test)
+  local PORT = 10088
+  local CLIENTS = 10
+  local accepted = 0
+
+  local server = lev.tcp.new()
+  server:bind("127.0.0.1", PORT)
+  test.throws(server.listen, server, function() end, 128, { batch = -1 })
+  server:listen(function(s, err, clients)
+    test.is_nil(err)
+    test.ok(#clients >= 1 and #clients <= 4)
+    for i = 1, #clients do
+      clients[i]:close()
+    end
+    accepted = accepted + #clients
+    if accepted == CLIENTS then
+      local stats = s:accept_stats()
+      test.equal(stats.accepted, CLIENTS)
+      test.ok(stats.batches >= CLIENTS / 4 and stats.batches <= CLIENTS)
+      s:close()
+      test.done()
+    end
+  end, 128, { batch = 4, nodelay = true, keepalive = 30 })
+
+  for i = 1, CLIENTS do
+    local client = lev.tcp.new()
+    client:connect("127.0.0.1", PORT, function(c)
+      c:close()
+    end)
+  end
+end
+
+exports['lev.tcp:\ttcp_batched_accept_close'] = function(test)
+  -- two batching listeners with connections pending in the same loop
+  -- iteration; whichever batch is handed out first closes both servers,
+  -- and the other one's held connections must never be delivered
+  local PORT = 10089
+  local servers, clients = {}, {}
+  local batches = 0
+
+  for i = 1, 2 do
+    local server = lev.tcp.new()
+    server:bind("127.0.0.1", PORT + i - 1)
+    server:listen(function(s, err, accepted)
+      batches = batches + 1
+      for j = 1, #accepted do
+        accepted[j]:close()
+      end
+      servers[1]:close()
+      servers[2]:close()
+    end, 128, { batch = 64 })
+    servers[i] = server
+  end
+
+  for i = 1, 2 do
+    for j = 1, 3 do
+      local client = lev.tcp.new()
+      client:connect("127.0.0.1", PORT + i - 1, function(c) end)
+      clients[#clients + 1] = client
+    end
+  end
+
+  lev.timer.new():start(function(t)
+    t:close()
+    test.equal(batches, 1)
+    for i = 1, #clients do
+      clients[i]:close()
+    end
+    test.done()
+  end, 50, 0)
+end
+
 return exports
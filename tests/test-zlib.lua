@@ -0,0 +1,134 @@
+--[[
+
+Copyright 2012 The lev Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+local lev = require('lev')
+local string = require('string')
+local table = require('table')
+
+local exports = {}
+
+local TEXT = string.rep('lev compresses responses and ipc payloads. ', 200)
+
+local function roundtrip(test, deflate_options, inflate_options)
+   local d = lev.zlib.deflate(deflate_options)
+   local parts = {}
+   for i = 1, #TEXT, 1000 do
+      local out, ended = d:write(Buffer:new(TEXT:sub(i, i + 999)))
+      test.ok(Buffer.isBuffer(out))
+      test.equal(ended, false)
+      parts[#parts + 1] = out:toString()
+   end
+   local tail, ended = d:finish()
+   test.equal(ended, true)
+   parts[#parts + 1] = tail:toString()
+   local compressed = table.concat(parts)
+   test.ok(#compressed < #TEXT / 10)
+
+   local i = lev.zlib.inflate(inflate_options)
+   local out, done = i:write(compressed)
+   test.equal(done, true)
+   test.equal(out:toString(), TEXT)
+   return compressed
+end
+
+exports['lev.zlib:\tformats'] = function(test)
+   local zlib = roundtrip(test, nil, { format = 'deflate' })
+   test.equal(zlib:byte(1), 0x78)
+
+   local gzip = roundtrip(test, { format = 'gzip', level = 9 }, { format = 'gzip' })
+   test.equal(gzip:byte(1), 0x1f)
+   test.equal(gzip:byte(2), 0x8b)
+
+   roundtrip(test, { format = 'raw', level = 1, strategy = 'rle' }, { format = 'raw' })
+   roundtrip(test, { format = 'gzip' }) -- inflate detects the header by default
+
+   test.throws(lev.zlib.deflate, { format = 'auto' })
+   test.throws(lev.zlib.deflate, { strategy = 'fastest' })
+   test.throws(lev.zlib.deflate, { level = 12 })
+
+   test.done()
+end
+
+exports['lev.zlib:\tflush'] = function(test)
+   local d = lev.zlib.deflate()
+   local i = lev.zlib.inflate()
+
+   -- a sync flush makes everything so far decompressible on the other side
+   local out = d:write('hello ', 'sync')
+   test.ok(#out > 0)
+   test.equal(i:write(out):toString(), 'hello ')
+   out = d:write(Buffer:new('world'), 'sync')
+   test.equal(i:write(out):toString(), 'world')
+
+   local tail = d:finish()
+   local rest, ended = i:write(tail)
+   test.equal(#rest, 0)
+   test.equal(ended, true)
+   test.throws(d.write, d, 'more')
+
+   -- reset starts a new stream with the same options
+   d:reset()
+   local again = d:finish('again')
+   test.equal(lev.zlib.inflate():finish(again):toString(), 'again')
+   local bytes_in, bytes_out, done = d:stats()
+   test.equal(bytes_in, 5)
+   test.equal(bytes_out, #again)
+   test.equal(done, true)
+
+   d:close()
+   test.throws(d.write, d, 'closed')
+
+   test.done()
+end
+
+exports['lev.zlib:\terrors'] = function(test)
+   local out, err = lev.zlib.inflate():write('this is not zlib data')
+   test.is_nil(out)
+   test.equal(type(err), 'string')
+
+   local compressed = lev.zlib.deflate():finish(TEXT)
+   out, err = lev.zlib.inflate():finish(compressed:slice(1, #compressed - 4))
+   test.is_nil(out)
+   test.equal(err, 'unexpected end of stream')
+
+   test.done()
+end
+
+exports['lev.zlib:\tlarge finish'] = function(test)
+   -- Z_FINISH reports a full output block as a buffer error; finish()
+   -- must grow the block and carry on, not call the stream truncated
+   local parts = {}
+   for n = 1, 5000 do
+      parts[n] = 'line ' .. n .. ' of a response body\n'
+   end
+   local big = table.concat(parts)
+   test.ok(#big > 64 * 1024)
+
+   local compressed = lev.zlib.deflate():finish(big)
+   local out, ended = lev.zlib.inflate():finish(compressed)
+   test.equal(ended, true)
+   test.equal(out:toString(), big)
+
+   out, ended = lev.zlib.inflate():write(compressed, 'finish')
+   test.equal(ended, true)
+   test.equal(#out, #big)
+
+   test.done()
+end
+
+return exports